@@ -17,14 +17,23 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <codecvt>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
 #include <cwctype>
+#include <exception>
 #include <limits>
 #include <locale>
 #include <regex>
 #include <sstream>
 #include <stack>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
 #include <time.h>
 #include "./dmp.h"
 
@@ -90,6 +99,240 @@ std::wstring fromPercentEncoding(const std::wstring &input)
   return ToUTF16(outputUTF8.str());
 }
 
+// Offsets at which each line of a text starts, plus one past the end.
+static std::vector<int> lineStarts(const std::wstring &text)
+{
+  std::vector<int> starts(1, 0);
+  for (size_t i = 0; i < text.length(); i++) {
+    if (text[i] == L'\n' && i + 1 < text.length()) {
+      starts.push_back(i + 1);
+    }
+  }
+  starts.push_back(text.length());
+  return starts;
+}
+
+// FNV-1a hash of text[start, end).
+static inline uint64_t hashRange(const std::wstring &text, int start, int end)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = start; i < end; i++) {
+    hash = (hash ^ static_cast<uint64_t>(text[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// MurmurHash3 (x64, 128-bit) of a byte range, continuing from the state
+// (h1, h2) so that several ranges can be chained into one hash.
+static void hash128(const void *data, size_t len, uint64_t &h1, uint64_t &h2)
+{
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  const size_t nblocks = len / 16;
+  for (size_t i = 0; i < nblocks; i++) {
+    uint64_t k1, k2;
+    std::memcpy(&k1, bytes + i * 16, 8);
+    std::memcpy(&k2, bytes + i * 16 + 8, 8);
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+  const unsigned char *tail = bytes + nblocks * 16;
+  uint64_t k1 = 0, k2 = 0;
+  for (size_t i = len & 15; i > 8; i--) {
+    k2 ^= static_cast<uint64_t>(tail[i - 1]) << ((i - 9) * 8);
+  }
+  for (size_t i = std::min<size_t>(len & 15, 8); i > 0; i--) {
+    k1 ^= static_cast<uint64_t>(tail[i - 1]) << ((i - 1) * 8);
+  }
+  k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+  k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  h1 ^= len; h2 ^= len;
+  h1 += h2; h2 += h1;
+  h1 = fmix64(h1); h2 = fmix64(h2);
+  h1 += h2; h2 += h1;
+}
+
+// Every line of two texts counted by hash, to find those which occur exactly
+// once in each.
+struct LineCounts {
+  struct Count {
+    int count1;
+    int count2;
+    int line2;  // Last line of text2 with this hash.
+  };
+  const std::wstring &text1;
+  const std::wstring &text2;
+  // Line starts of each text, then its end.
+  std::vector<int> lines1;
+  std::vector<int> lines2;
+  std::vector<uint64_t> hashes1;
+  std::unordered_map<uint64_t, Count> counts;
+
+  LineCounts(const std::wstring &text1, const std::wstring &text2) :
+    text1(text1), text2(text2), lines1(lineStarts(text1)), lines2(lineStarts(text2)),
+    hashes1(lines1.size() - 1) {
+    for (size_t i = 0; i + 1 < lines1.size(); i++) {
+      hashes1[i] = hashRange(text1, lines1[i], lines1[i + 1]);
+      counts[hashes1[i]].count1++;
+    }
+    for (size_t j = 0; j + 1 < lines2.size(); j++) {
+      Count &lineCount = counts[hashRange(text2, lines2[j], lines2[j + 1])];
+      lineCount.count2++;
+      lineCount.line2 = j;
+    }
+  }
+
+  // A line unique to both texts pins the same spot in each; returns the
+  // line number in text2 of line i of text1, or -1 if it is not unique.
+  int anchor(int i) const {
+    const Count &lineCount = counts.at(hashes1[i]);
+    if (lineCount.count1 != 1 || lineCount.count2 != 1) {
+      return -1;
+    }
+    const int j = lineCount.line2;
+    const int length = lines1[i + 1] - lines1[i];
+    if (length != lines2[j + 1] - lines2[j]
+        || text1.compare(lines1[i], length, text2, lines2[j], length) != 0) {
+      return -1;  // Hash collision.
+    }
+    return j;
+  }
+};
+
+// A line found exactly once in each of two texts.
+struct LineAnchor {
+  int start1;
+  int start2;
+  int length;
+};
+
+// The longest sequence of lines which occur exactly once in each text and
+// in the same order in both (as in patience diff).  Consecutive lines are
+// not merged.
+static std::vector<LineAnchor> uniqueLineAnchors(const std::wstring &text1,
+                                                 const std::wstring &text2)
+{
+  std::vector<LineAnchor> anchors;
+  const LineCounts counts(text1, text2);
+  const std::vector<int> &lines1 = counts.lines1;
+  const std::vector<int> &lines2 = counts.lines2;
+  const int count1 = lines1.size() - 1;
+  const int count2 = lines2.size() - 1;
+  if (count1 < 2 && count2 < 2) {
+    return anchors;
+  }
+
+  // Pair up the lines unique to both texts, in text1 order.
+  std::vector<LineAnchor> pairs;
+  for (int i = 0; i < count1; i++) {
+    const int j = counts.anchor(i);
+    if (j != -1) {
+      pairs.push_back(LineAnchor{lines1[i], lines2[j], lines1[i + 1] - lines1[i]});
+    }
+  }
+  if (pairs.empty()) {
+    return anchors;
+  }
+
+  // Longest increasing subsequence of the text2 positions by patience
+  // sorting.  tails[k] is the pair ending the best run of length k + 1.
+  std::vector<int> tails;
+  std::vector<int> previous(pairs.size(), -1);
+  for (size_t p = 0; p < pairs.size(); p++) {
+    auto pile = std::lower_bound(tails.begin(), tails.end(), pairs[p].start2,
+        [&pairs](int t, int start2) { return pairs[t].start2 < start2; });
+    if (pile != tails.begin()) {
+      previous[p] = *(pile - 1);
+    }
+    if (pile == tails.end()) {
+      tails.push_back(p);
+    } else {
+      *pile = p;
+    }
+  }
+  anchors.resize(tails.size());
+  int k = tails.size();
+  for (int p = tails.back(); p != -1; p = previous[p]) {
+    anchors[--k] = pairs[p];
+  }
+  return anchors;
+}
+
+// Run work(i) for every i < count on up to `threads` threads (0 meaning one
+// per hardware thread), taking the items in order of decreasing cost.  The
+// first exception thrown by any item is rethrown once all threads finish.
+static void runBatch(const std::vector<size_t> &costs, int threads,
+                     const std::function<void(size_t)> &work)
+{
+  std::vector<size_t> order(costs.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) {
+    return costs[a] > costs[b];
+  });
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<int>(std::min<size_t>(threads, order.size()));
+
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next++) < order.size()) {
+      try {
+        work(order[i]);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(std::max(0, threads - 1));
+  try {
+    for (int t = 1; t < threads; t++) {
+      pool.emplace_back(worker);
+    }
+  } catch (...) {
+    // Out of threads.  Let those already started finish their items.
+    next = order.size();
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+    throw;
+  }
+  worker();
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
 //////////////////////////
 //
 // Diff Class
@@ -221,82 +464,1078 @@ std::wstring Patch::toString() const {
 }
 
 
+/////////////////////////////////////////////
+//
+// DiffPlan Class
+//
+/////////////////////////////////////////////
+
+
+DiffPlan::DiffPlan() :
+  strategy(Strategy::Trivial), anchored(false), halfMatch(false),
+  length1(0), length2(0), lines1(0), lines2(0),
+  lineSimilarity(-1), alphabet(-1) {
+}
+
+
+std::wstring DiffPlan::strStrategy(Strategy strategy) {
+  switch (strategy) {
+    case Strategy::Trivial:
+      return L"Trivial";
+    case Strategy::LineMode:
+      return L"LineMode";
+    case Strategy::WordMode:
+      return L"WordMode";
+    case Strategy::BitParallel:
+      return L"BitParallel";
+    case Strategy::ONP:
+      return L"ONP";
+    case Strategy::Bisect:
+      return L"Bisect";
+  }
+  throw "Invalid strategy.";
+}
+
+/**
+ * Display a human-readable version of this plan.
+ * @return text version
+ */
+std::wstring DiffPlan::toString() const {
+  std::wstring text = L"DiffPlan(" + strStrategy(strategy);
+  if (anchored) {
+    text += L", anchored";
+  }
+  if (halfMatch) {
+    text += L", half-match";
+  }
+  return text + L": " + reason + L")";
+}
+
+
+/////////////////////////////////////////////
+//
+// DiffStats Class
+//
+/////////////////////////////////////////////
+
+
+DiffStats::DiffStats() :
+  equalChars(0), deletedChars(0), insertedChars(0), lines1(0), lines2(0),
+  deletedLines(0), insertedLines(0), hunks(0), levenshtein(0) {
+}
+
+/**
+ * Display a human-readable version of these counts.
+ * @return text version
+ */
+std::wstring DiffStats::toString() const {
+  return L"DiffStats(=" + std::to_wstring(equalChars)
+      + L" -" + std::to_wstring(deletedChars)
+      + L" +" + std::to_wstring(insertedChars)
+      + L", lines -" + std::to_wstring(deletedLines) + L"/" + std::to_wstring(lines1)
+      + L" +" + std::to_wstring(insertedLines) + L"/" + std::to_wstring(lines2)
+      + L", " + std::to_wstring(hunks) + L" hunks, levenshtein "
+      + std::to_wstring(levenshtein) + L")";
+}
+
+
+/////////////////////////////////////////////
+//
+// MatchAlphabet Class
+//
+/////////////////////////////////////////////
+
+
+MatchAlphabet::MatchAlphabet(const std::wstring &pattern) :
+  maskWords(std::max<int>(1, (pattern.length() + 63) / 64)),
+  ascii(128 * maskWords), multiplier(0), shift(31), none(maskWords) {
+  std::vector<wchar_t> others;
+  for (wchar_t c : pattern) {
+    if (static_cast<uint32_t>(c) >= 128) {
+      others.push_back(c);
+    }
+  }
+  std::sort(others.begin(), others.end());
+  others.erase(std::unique(others.begin(), others.end()), others.end());
+
+  // Find a multiplier under which none of the other characters collide, in a
+  // table at least twice their number.  Widen the table if it takes long.
+  int bits = 1;
+  while ((size_t(1) << bits) < 2 * others.size()) {
+    bits++;
+  }
+  std::vector<bool> used;
+  for (uint32_t attempt = 0; ; attempt++) {
+    if (attempt != 0 && attempt % 16 == 0) {
+      bits++;
+    }
+    multiplier = (0x9E3779B9u + attempt * 0x6A09E667u) | 1;
+    shift = 32 - bits;
+    used.assign(size_t(1) << bits, false);
+    bool collided = false;
+    for (wchar_t c : others) {
+      const uint32_t slot = (static_cast<uint32_t>(c) * multiplier) >> shift;
+      collided = collided || used[slot];
+      used[slot] = true;
+    }
+    if (!collided) {
+      break;
+    }
+  }
+  // Slots never hold an ASCII character, so 0 marks an empty one.
+  keys.assign(size_t(1) << bits, 0);
+  masks.assign((size_t(1) << bits) * maskWords, 0);
+
+  const int length = pattern.length();
+  for (int i = 0; i < length; i++) {
+    const wchar_t c = pattern[i];
+    uint64_t *mask;
+    if (static_cast<uint32_t>(c) < 128) {
+      mask = &ascii[c * maskWords];
+    } else {
+      const uint32_t slot = (static_cast<uint32_t>(c) * multiplier) >> shift;
+      keys[slot] = c;
+      mask = &masks[slot * maskWords];
+    }
+    const int bit = length - i - 1;
+    mask[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+}
+
+
+int MatchAlphabet::words() const {
+  return maskWords;
+}
+
+
+const uint64_t *MatchAlphabet::operator[](wchar_t c) const {
+  if (static_cast<uint32_t>(c) < 128) {
+    return &ascii[c * maskWords];
+  }
+  const uint32_t slot = (static_cast<uint32_t>(c) * multiplier) >> shift;
+  return keys[slot] == c ? &masks[slot * maskWords] : none.data();
+}
+
+
+/////////////////////////////////////////////
+//
+// MatchPattern Class
+//
+/////////////////////////////////////////////
+
+MatchPattern::MatchPattern(const std::wstring &pattern) :
+  pattern(pattern), masks(pattern) {
+  for (size_t e = 0; e <= pattern.length(); e++) {
+    accuracies.push_back(static_cast<float>(e) / pattern.length());
+  }
+}
+
+
+const std::wstring &MatchPattern::text() const {
+  return pattern;
+}
+
+
+const MatchAlphabet &MatchPattern::alphabet() const {
+  return masks;
+}
+
+
+float MatchPattern::accuracy(int e) const {
+  if (e >= 0 && static_cast<size_t>(e) < accuracies.size()) {
+    return accuracies[e];
+  }
+  return static_cast<float>(e) / pattern.length();
+}
+
+
+/////////////////////////////////////////////
+//
+// MatchIndex Class
+//
+/////////////////////////////////////////////
+
+// Length of the blocks a MatchIndex cuts its text into.
+static const int matchIndexBlock = 64;
+
+
+MatchIndex::MatchIndex(const std::wstring &text, int gramLength) :
+  content(text), length(std::max(0, gramLength)) {
+  for (size_t start = 0; start == 0 || start < content.length(); start += matchIndexBlock) {
+    blockOrder.push_back(blockStarts.size());
+    blockStarts.push_back(start);
+  }
+  blockOrder.push_back(blockStarts.size());
+  blockStarts.push_back(content.length());
+  add(0, content.length());
+}
+
+
+const std::wstring &MatchIndex::text() const {
+  return content;
+}
+
+
+int MatchIndex::gramLength() const {
+  return length;
+}
+
+
+void MatchIndex::replace(size_t pos, size_t count, const std::wstring &replacement) {
+  if (length == 0) {
+    content.replace(pos, count, replacement);
+    return;
+  }
+  // The blocks from the one holding pos to the one holding pos + count are
+  // cut afresh.  Everything indexed there, or overlapping the replaced part,
+  // goes and comes back with the new text and offsets.
+  const int first = std::max<int>(0, pos - length + 1);
+  const size_t firstBlock = order(pos);
+  const size_t lastBlock = order(pos + count);
+  const int begin = blockStarts[blockOrder[firstBlock]];
+  const int end = blockStarts[blockOrder[lastBlock + 1]];
+  remove(first, end);
+  content.replace(pos, count, replacement);
+  const int delta = static_cast<int>(replacement.length()) - static_cast<int>(count);
+  for (size_t b = lastBlock + 1; b < blockOrder.size(); b++) {
+    blockStarts[blockOrder[b]] += delta;
+  }
+  // The first block keeps its number, since what it holds before 'first'
+  // stays indexed.  The others' numbers are reused, and new ones added if
+  // the blocks now take more.
+  std::vector<uint32_t> cut(1, blockOrder[firstBlock]);
+  for (int start = begin + matchIndexBlock; start < end + delta; start += matchIndexBlock) {
+    const size_t reused = firstBlock + cut.size();
+    if (reused <= lastBlock) {
+      cut.push_back(blockOrder[reused]);
+    } else {
+      cut.push_back(blockStarts.size());
+      blockStarts.push_back(0);
+    }
+    blockStarts[cut.back()] = start;
+  }
+  blockOrder.erase(blockOrder.begin() + firstBlock, blockOrder.begin() + lastBlock + 1);
+  blockOrder.insert(blockOrder.begin() + firstBlock, cut.begin(), cut.end());
+  add(first, end + delta);
+}
+
+
+size_t MatchIndex::count(const wchar_t *gram) const {
+  auto list = postings.find(key(gram));
+  return list == postings.end() ? 0 : list->second.size();
+}
+
+
+void MatchIndex::find(const wchar_t *gram, int from, int to,
+                      std::vector<int> &found) const {
+  auto list = postings.find(key(gram));
+  if (list == postings.end() || from > to
+      || from > static_cast<int>(content.length()) - length) {
+    return;
+  }
+  for (auto it = std::lower_bound(list->second.begin(), list->second.end(), from,
+                                  [this](uint64_t entry, int pos) {
+         return position(entry) < pos;
+       });
+       it != list->second.end(); ++it) {
+    const int pos = position(*it);
+    if (pos > to) {
+      break;
+    }
+    found.push_back(pos);
+  }
+}
+
+
+uint64_t MatchIndex::key(const wchar_t *gram) const {
+  // FNV-1a.  Substrings which collide share their positions, which only
+  // costs a wasted search.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < length; i++) {
+    hash = (hash ^ static_cast<uint32_t>(gram[i])) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+
+uint64_t MatchIndex::locate(int pos) const {
+  const uint32_t block = blockOrder[order(pos)];
+  return (static_cast<uint64_t>(block) << 32) | (pos - blockStarts[block]);
+}
+
+
+size_t MatchIndex::order(int pos) const {
+  // The last block starting at or before pos; of several, the one which is
+  // not empty.
+  return std::upper_bound(blockOrder.begin(), blockOrder.end() - 1, pos,
+                          [this](int at, uint32_t block) {
+    return at < blockStarts[block];
+  }) - blockOrder.begin() - 1;
+}
+
+
+int MatchIndex::position(uint64_t entry) const {
+  return blockStarts[entry >> 32] + static_cast<int>(entry & 0xffffffff);
+}
+
+
+void MatchIndex::add(int begin, int end) {
+  end = std::min(end, static_cast<int>(content.length()) - length + 1);
+  for (int p = std::max(0, begin); p < end; p++) {
+    std::vector<uint64_t> &list = postings[key(&content[p])];
+    list.insert(std::upper_bound(list.begin(), list.end(), p,
+                                 [this](int pos, uint64_t entry) {
+                  return pos < position(entry);
+                }), locate(p));
+  }
+}
+
+
+void MatchIndex::remove(int begin, int end) {
+  end = std::min(end, static_cast<int>(content.length()) - length + 1);
+  for (int p = std::max(0, begin); p < end; p++) {
+    auto found = postings.find(key(&content[p]));
+    std::vector<uint64_t> &list = found->second;
+    list.erase(std::lower_bound(list.begin(), list.end(), p,
+                                [this](uint64_t entry, int pos) {
+                 return position(entry) < pos;
+               }));
+    if (list.empty()) {
+      postings.erase(found);
+    }
+  }
+}
+
+
 /////////////////////////////////////////////
 //
 // diff_match_patch Class
 //
 /////////////////////////////////////////////
 
-diff_match_patch::diff_match_patch() :
+DiffMatchPatchOptions::DiffMatchPatchOptions() :
   Diff_Timeout(1.0f),
   Diff_EditCost(4),
   Match_Threshold(0.5f),
   Match_Distance(1000),
   Patch_DeleteThreshold(0.5f),
   Patch_Margin(4),
-  Match_MaxBits(32) {
+  Patch_IndexGram(0),
+  Match_MaxBits(64),
+  Match_Algorithm(MatchAlgorithm::Bitap),
+  Diff_Algorithm(DiffAlgorithm::Myers),
+  Diff_Anchoring(false),
+  Diff_LineModeLength(100),
+  Diff_BitParallelCells(int64_t(1) << 22),
+  Diff_ONPRatio(4.0f),
+  Diff_WordModeLineLength(200),
+  Diff_MinTokenAlphabet(8),
+  Diff_AnchorMinLines(64),
+  Diff_AnchorSimilarity(0.5f),
+  Diff_Race(false),
+  Diff_RaceSlack(0.1f) {
+}
+
+
+diff_match_patch::diff_match_patch() {
+}
+
+
+diff_match_patch::diff_match_patch(const Options &options) :
+  DiffMatchPatchOptions(options) {
+}
+
+
+const diff_match_patch::Options &diff_match_patch::options() const {
+  return *this;
+}
+
+// Set on diff_race's threads.  Once it turns true the engines give up as
+// though their deadline had passed.
+static thread_local const std::atomic<bool> *diffCancelled = nullptr;
+
+// Deadlines are in clock_t ticks, but read from a monotonic wall clock
+// rather than clock(): that counts the CPU time of the whole process, which
+// diffs running side by side on several threads would use up together.
+static clock_t diffClock()
+{
+  static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - origin;
+  return static_cast<clock_t>(elapsed.count() * CLOCKS_PER_SEC);
+}
+
+static bool pastDeadline(clock_t deadline)
+{
+  return diffClock() > deadline
+      || (diffCancelled != nullptr && diffCancelled->load(std::memory_order_relaxed));
 }
 
+// Per-thread scratch buffers are kept from call to call, unless a call left
+// one larger than this many bytes: that is freed again once the call is done.
+static const size_t scratchKeepBytes = 1 << 20;
+
+template <typename T>
+class ScratchTrim {
+ public:
+  explicit ScratchTrim(std::vector<T> &buffer) : buffers(&buffer), count(1) {
+  }
+  ScratchTrim(std::vector<T> *buffers, int count) : buffers(buffers), count(count) {
+  }
+  ~ScratchTrim() {
+    for (int i = 0; i < count; i++) {
+      if (buffers[i].capacity() * sizeof(T) > scratchKeepBytes) {
+        std::vector<T>().swap(buffers[i]);
+      }
+    }
+  }
+
+ private:
+  std::vector<T> *buffers;
+  int count;
+};
+
 
 std::deque<Diff> diff_match_patch::diff_main(const std::wstring &text1,
-                                        const std::wstring &text2) {
+                                        const std::wstring &text2) const {
   return diff_main(text1, text2, true);
 }
 
 std::deque<Diff> diff_match_patch::diff_main(const std::wstring &text1,
-    const std::wstring &text2, bool checklines) {
+    const std::wstring &text2, bool checklines) const {
+  // Set a deadline by which time the diff must be complete.
+  clock_t deadline;
+  if (Diff_Timeout <= 0) {
+    deadline = std::numeric_limits<clock_t>::max();
+  } else {
+    deadline = diffClock() + (clock_t)(Diff_Timeout * CLOCKS_PER_SEC);
+  }
+  if (Diff_Race) {
+    return diff_race(text1, text2, checklines, deadline);
+  }
+  return diff_main(text1, text2, checklines, deadline);
+}
+
+void diff_match_patch::diff_main(const std::wstring &text1,
+    const std::wstring &text2, bool checklines, const DiffSink &sink) const {
   // Set a deadline by which time the diff must be complete.
   clock_t deadline;
   if (Diff_Timeout <= 0) {
     deadline = std::numeric_limits<clock_t>::max();
   } else {
-    deadline = clock() + (clock_t)(Diff_Timeout * CLOCKS_PER_SEC);
+    deadline = diffClock() + (clock_t)(Diff_Timeout * CLOCKS_PER_SEC);
+  }
+  // Hold back the last operation so that neighbouring regions which end and
+  // start with the same operation reach the sink as a single diff.
+  Diff pending(Diff::Operation::Equal, L"");
+  diff_stream(text1, text2, checklines, deadline,
+      [&pending, &sink](Diff::Operation op, const std::wstring &text) {
+    if (text.empty()) {
+      return;
+    }
+    if (op == pending.operation) {
+      pending.text += text;
+    } else {
+      if (!pending.text.empty()) {
+        sink(pending.operation, pending.text);
+      }
+      pending = Diff(op, text);
+    }
+  });
+  if (!pending.text.empty()) {
+    sink(pending.operation, pending.text);
+  }
+}
+
+// Estimated cost of diffing a pair: the size of what is left once the
+// common prefix and suffix are stripped.
+static std::vector<size_t> batchCosts(
+    const std::vector<std::pair<std::wstring, std::wstring>> &pairs) {
+  std::vector<size_t> costs(pairs.size());
+  for (size_t i = 0; i < pairs.size(); i++) {
+    const std::wstring &text1 = pairs[i].first;
+    const std::wstring &text2 = pairs[i].second;
+    const size_t n = std::min(text1.length(), text2.length());
+    const size_t prefix = std::mismatch(text1.begin(), text1.begin() + n,
+                                        text2.begin()).first - text1.begin();
+    const size_t suffix = std::mismatch(text1.rbegin(),
+                                        text1.rbegin() + (n - prefix),
+                                        text2.rbegin()).first - text1.rbegin();
+    costs[i] = text1.length() + text2.length() - 2 * (prefix + suffix);
+  }
+  return costs;
+}
+
+std::vector<std::deque<Diff>> diff_match_patch::diff_batch(
+    const std::vector<std::pair<std::wstring, std::wstring>> &pairs,
+    int threads) const {
+  std::vector<std::deque<Diff>> results(pairs.size());
+  runBatch(batchCosts(pairs), threads, [&](size_t i) {
+    results[i] = diff_main(pairs[i].first, pairs[i].second);
+  });
+  return results;
+}
+
+std::deque<Diff> diff_match_patch::diff_main(const std::wstring &text1,
+    const std::wstring &text2, bool checklines, clock_t deadline) const {
+  // Check for equality (speedup).
+  std::deque<Diff> diffs;
+  if (text1 == text2) {
+    if (!text1.empty()) {
+      diffs.push_back(Diff(Diff::Operation::Equal, text1));
+    }
+    return diffs;
+  }
+
+  // Trim off common prefix (speedup).
+  int commonlength = diff_commonPrefix(text1, text2);
+  const std::wstring &commonprefix = text1.substr(0, commonlength);
+  std::wstring textChopped1 = text1.substr(commonlength);
+  std::wstring textChopped2 = text2.substr(commonlength);
+
+  // Trim off common suffix (speedup).
+  commonlength = diff_commonSuffix(textChopped1, textChopped2);
+  const std::wstring &commonsuffix = textChopped1.substr(textChopped1.length() - commonlength);
+  textChopped1 = textChopped1.substr(0, textChopped1.length() - commonlength);
+  textChopped2 = textChopped2.substr(0, textChopped2.length() - commonlength);
+
+  // Compute the diff on the middle block.
+  diffs = diff_compute(textChopped1, textChopped2, checklines, deadline);
+
+  // Restore the prefix and suffix.
+  if (!commonprefix.empty()) {
+    diffs.push_front(Diff(Diff::Operation::Equal, commonprefix));
+  }
+  if (!commonsuffix.empty()) {
+    diffs.push_back(Diff(Diff::Operation::Equal, commonsuffix));
+  }
+
+  diff_cleanupMerge(diffs);
+
+  return diffs;
+}
+
+
+void diff_match_patch::diff_stream(const std::wstring &text1,
+    const std::wstring &text2, bool checklines, clock_t deadline,
+    const DiffSink &emit) const {
+  // Check for equality (speedup).
+  if (text1 == text2) {
+    emit(Diff::Operation::Equal, text1);
+    return;
+  }
+
+  // Trim off common prefix and suffix (speedup).
+  const int prefixLength = diff_commonPrefix(text1, text2);
+  std::wstring textChopped1 = text1.substr(prefixLength);
+  std::wstring textChopped2 = text2.substr(prefixLength);
+  const int suffixLength = diff_commonSuffix(textChopped1, textChopped2);
+  textChopped1.resize(textChopped1.length() - suffixLength);
+  textChopped2.resize(textChopped2.length() - suffixLength);
+
+  // The prefix is final as soon as it is known.
+  emit(Diff::Operation::Equal, text1.substr(0, prefixLength));
+  diff_streamCompute(textChopped1, textChopped2, checklines, deadline, emit);
+  emit(Diff::Operation::Equal, text1.substr(text1.length() - suffixLength));
+}
+
+
+// Number of characters inserted or deleted by a diff.
+static long editCost(const std::deque<Diff> &diffs)
+{
+  long cost = 0;
+  for (const Diff &aDiff : diffs) {
+    if (aDiff.operation != Diff::Operation::Equal) {
+      cost += aDiff.text.length();
+    }
+  }
+  return cost;
+}
+
+// Lower bound on editCost for any diff of the texts: whatever one text has
+// more of a character than the other must be deleted or inserted.  This is
+// weak: text which moved, or was swapped for text using the same characters,
+// costs nothing here, so for such texts no diff may come within reach of it.
+static long editLowerBound(const std::wstring &text1, const std::wstring &text2)
+{
+  std::unordered_map<wchar_t, long> surplus;
+  for (wchar_t ch : text1) {
+    surplus[ch]++;
+  }
+  for (wchar_t ch : text2) {
+    surplus[ch]--;
+  }
+  long bound = 0;
+  for (const auto &entry : surplus) {
+    bound += std::abs(entry.second);
+  }
+  return bound;
+}
+
+
+// Counts diff_race's contenders still running, which may outlive their race.
+// Made on the first race, so it is destroyed before the statics the engines
+// use, and waits for the stragglers then; they have all been cancelled.
+class RaceStragglers {
+ public:
+  ~RaceStragglers() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return running == 0; });
+  }
+
+  static RaceStragglers &instance() {
+    static RaceStragglers stragglers;
+    return stragglers;
+  }
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int running = 0;
+};
+
+
+std::deque<Diff> diff_match_patch::diff_race(const std::wstring &text1,
+    const std::wstring &text2, bool checklines, clock_t deadline) const {
+  Options options = *this;
+  options.Diff_Race = false;
+  // Small diffs are over before a thread could be started, and contenders
+  // sharing a core only slow each other down.
+  const unsigned int cores = std::thread::hardware_concurrency();
+  if (static_cast<int64_t>(text1.length()) * static_cast<int64_t>(text2.length())
+      <= Diff_BitParallelCells || cores == 1) {
+    return diff_match_patch(options).diff_main(text1, text2, checklines, deadline);
+  }
+
+  // The race is held in shared state, so that losers still running when the
+  // winner is returned can be left to notice they were cancelled and quit.
+  struct Race {
+    std::wstring text1;
+    std::wstring text2;
+    std::vector<std::pair<Options, bool>> contenders;
+    double goal;
+    std::atomic<bool> cancelled;
+    std::mutex mutex;
+    std::condition_variable finished;
+    int running;
+    std::deque<Diff> best;
+    long bestCost;
+    std::exception_ptr error;
+  };
+  const std::shared_ptr<Race> race = std::make_shared<Race>();
+  race->cancelled = false;
+  race->running = 0;
+  race->bestCost = -1;
+
+  // The contenders: as configured, character by character, and the other
+  // ways of aligning lines; no more of them than there are cores.
+  std::vector<std::pair<Options, bool>> &contenders = race->contenders;
+  contenders.push_back(std::make_pair(options, checklines));
+  if (checklines) {
+    contenders.push_back(std::make_pair(options, false));
+  }
+  for (DiffAlgorithm algorithm : {DiffAlgorithm::Auto, DiffAlgorithm::Histogram}) {
+    if (options.Diff_Algorithm != algorithm
+        && (checklines || algorithm == DiffAlgorithm::Auto)) {
+      Options other = options;
+      other.Diff_Algorithm = algorithm;
+      contenders.push_back(std::make_pair(other, checklines));
+    }
+  }
+  if (cores != 0 && contenders.size() > cores) {
+    contenders.resize(cores);
+  }
+
+  race->goal = (1 + Diff_RaceSlack) * editLowerBound(text1, text2);
+  auto run = [deadline](const std::shared_ptr<Race> &race, size_t k,
+      const std::wstring &text1, const std::wstring &text2) {
+    diffCancelled = &race->cancelled;
+    std::deque<Diff> diffs;
+    std::exception_ptr failure;
+    try {
+      diffs = diff_match_patch(race->contenders[k].first).diff_main(
+          text1, text2, race->contenders[k].second, deadline);
+    } catch (...) {
+      failure = std::current_exception();
+    }
+    diffCancelled = nullptr;
+
+    std::lock_guard<std::mutex> lock(race->mutex);
+    race->running--;
+    if (failure) {
+      if (!race->error) {
+        race->error = failure;
+      }
+    } else if (!race->cancelled) {
+      // A cancelled contender's diff is a rushed one; only count those which
+      // finished on their own.
+      const long cost = editCost(diffs);
+      if (race->bestCost < 0 || cost < race->bestCost) {
+        race->best = std::move(diffs);
+        race->bestCost = cost;
+      }
+      // Close enough to the bound, or the configured contender is in: a
+      // race is never slower than diff_main would have been on its own.
+      if (cost <= race->goal || k == 0) {
+        race->cancelled = true;
+      }
+    }
+    race->finished.notify_all();
+  };
+
+  if (contenders.size() > 1) {
+    // The other contenders get their own copy of the texts, which the caller
+    // need not keep once the winner is returned.
+    race->text1 = text1;
+    race->text2 = text2;
+  }
+  RaceStragglers &stragglers = RaceStragglers::instance();
+  for (size_t k = 1; k < contenders.size(); k++) {
+    {
+      std::lock_guard<std::mutex> lock(race->mutex);
+      race->running++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(stragglers.mutex);
+      stragglers.running++;
+    }
+    try {
+      std::thread([run, race, k, &stragglers] {
+        run(race, k, race->text1, race->text2);
+        std::lock_guard<std::mutex> lock(stragglers.mutex);
+        stragglers.running--;
+        stragglers.done.notify_all();
+      }).detach();
+    } catch (...) {
+      // Out of threads.  Call off those already started.
+      {
+        std::lock_guard<std::mutex> lock(stragglers.mutex);
+        stragglers.running--;
+      }
+      race->cancelled = true;
+      throw;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(race->mutex);
+    race->running++;
+  }
+  run(race, 0, text1, text2);
+
+  // Only if the configured contender failed is there anyone to wait for.
+  std::unique_lock<std::mutex> lock(race->mutex);
+  race->finished.wait(lock, [&race] {
+    return race->cancelled || race->running == 0;
+  });
+  race->cancelled = true;
+  if (race->bestCost < 0) {
+    std::rethrow_exception(race->error);
+  }
+  return std::move(race->best);
+}
+
+
+bool diff_match_patch::diff_bounded(const std::wstring &text1,
+    const std::wstring &text2, int maxEdits, std::deque<Diff> &diffs) const {
+  // Texts too far apart by length or content are out without a search.
+  if (std::abs(static_cast<long>(text1.length()) - static_cast<long>(text2.length())) > maxEdits
+      || editLowerBound(text1, text2) > maxEdits) {
+    return false;
+  }
+  std::deque<Diff> result;
+  if (diff_boundedCompute(text1, text2, maxEdits, result) < 0) {
+    return false;
+  }
+  diff_cleanupMerge(result);
+  diffs.swap(result);
+  return true;
+}
+
+
+int diff_match_patch::diff_boundedCompute(const std::wstring &text1,
+    const std::wstring &text2, int maxEdits, std::deque<Diff> &diffs) const {
+  // Trim off the common prefix and suffix.
+  const int prefix = diff_commonPrefix(text1, text2);
+  const int suffix = diff_commonSuffix(text1.substr(prefix), text2.substr(prefix));
+  const int length1 = text1.length() - prefix - suffix;
+  const int length2 = text2.length() - prefix - suffix;
+  if (prefix != 0) {
+    diffs.push_back(Diff(Diff::Operation::Equal, text1.substr(0, prefix)));
+  }
+
+  int edits;
+  if (length1 == 0 || length2 == 0) {
+    edits = length1 + length2;
+    if (edits > maxEdits) {
+      return -1;
+    }
+    if (length1 != 0) {
+      diffs.push_back(Diff(Diff::Operation::Delete, text1.substr(prefix, length1)));
+    }
+    if (length2 != 0) {
+      diffs.push_back(Diff(Diff::Operation::Insert, text2.substr(prefix, length2)));
+    }
+  } else {
+    // The paths of a diff of D edits meet within (D + 1) / 2 steps of either
+    // end, so they need go no further than that.
+    const std::wstring middle1 = text1.substr(prefix, length1);
+    const std::wstring middle2 = text2.substr(prefix, length2);
+    const int full_d = (length1 + length2 + 1) / 2;
+    const int band_d = (maxEdits + 1) / 2 + 1;
+    int x, y;
+    edits = diff_bisectMiddle(middle1, middle2, std::min(full_d, band_d),
+        std::numeric_limits<clock_t>::max(), x, y);
+    if (edits < 0 && band_d >= full_d && length1 + length2 <= maxEdits) {
+      // Nothing in common, as diff_bisect concludes from the same search.
+      diffs.push_back(Diff(Diff::Operation::Delete, middle1));
+      diffs.push_back(Diff(Diff::Operation::Insert, middle2));
+      edits = length1 + length2;
+    } else if (edits < 0 || edits > maxEdits) {
+      return -1;
+    } else {
+      // The split lies on a minimal path, so the halves share out exactly
+      // that many edits.
+      const int editsA = diff_boundedCompute(middle1.substr(0, x), middle2.substr(0, y),
+                                             edits, diffs);
+      diff_boundedCompute(middle1.substr(x), middle2.substr(y), edits - editsA, diffs);
+    }
+  }
+
+  if (suffix != 0) {
+    diffs.push_back(Diff(Diff::Operation::Equal, text1.substr(text1.length() - suffix)));
+  }
+  return edits;
+}
+
+
+// Whether the Levenshtein distance of a and b is at most k, by dynamic
+// programming over the diagonals within k of the main one.  Stops at the
+// first row where no cell can still lead to the end within k.
+static bool levenshteinBanded(const wchar_t *a, int m, const wchar_t *b, int n, int k)
+{
+  const int width = 2 * k + 1;
+  const int far = k + 1;
+  static thread_local std::vector<int> rows;
+  const ScratchTrim<int> trim(rows);
+  if (rows.size() < 2 * static_cast<size_t>(width)) {
+    rows.resize(2 * width);
+  }
+  // Cell d of the row for b[0..j) holds D[i][j] for i = j - k + d.
+  int *previous = rows.data();
+  int *row = previous + width;
+  for (int d = 0; d < width; d++) {
+    const int i = d - k;
+    previous[d] = i >= 0 && i <= m ? std::min(i, far) : far;
+  }
+  for (int j = 1; j <= n; j++) {
+    bool open = false;
+    for (int d = 0; d < width; d++) {
+      const int i = j - k + d;
+      int cost = far;
+      if (i == 0) {
+        cost = std::min(j, far);
+      } else if (i > 0 && i <= m) {
+        cost = previous[d] + (a[i - 1] != b[j - 1]);
+        if (d > 0) {
+          cost = std::min(cost, row[d - 1] + 1);
+        }
+        if (d + 1 < width) {
+          cost = std::min(cost, previous[d + 1] + 1);
+        }
+        cost = std::min(cost, far);
+      }
+      row[d] = cost;
+      // The rest of the way costs at least the difference in lengths left.
+      open = open || (i >= 0 && i <= m && cost + std::abs((n - j) - (m - i)) <= k);
+    }
+    if (!open) {
+      return false;
+    }
+    std::swap(previous, row);
+  }
+  return previous[m - (n - k)] <= k;
+}
+
+// One column of Myers' bit-vector algorithm (1999), over blocks of 64 rows:
+// advances the vertical deltas of a column, +1 in plus and -1 in minus, by a
+// character whose pattern mask is eq.  carry is the horizontal delta of row
+// 0, +1 for a global distance and 0 for a match starting anywhere.  last
+// marks the pattern's last row in the last block.
+// Returns the horizontal delta of the last row.
+static int myersColumn(const uint64_t *eq, uint64_t *plus, uint64_t *minus, int words,
+                       uint64_t last, int carry)
+{
+  for (int w = 0; w < words; w++) {
+    uint64_t match = eq[w];
+    const uint64_t pv = plus[w];
+    const uint64_t mv = minus[w];
+    const uint64_t xv = match | mv;
+    if (carry < 0) {
+      match |= 1;
+    }
+    const uint64_t xh = (((match & pv) + pv) ^ pv) | match;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+    const uint64_t top = w + 1 == words ? last : uint64_t(1) << 63;
+    const int out = (ph & top) ? 1 : (mh & top) ? -1 : 0;
+    ph <<= 1;
+    mh <<= 1;
+    if (carry < 0) {
+      mh |= 1;
+    } else if (carry > 0) {
+      ph |= 1;
+    }
+    plus[w] = mh | ~(xv | ph);
+    minus[w] = ph & xv;
+    carry = out;
   }
-  return diff_main(text1, text2, checklines, deadline);
+  return carry;
 }
 
-std::deque<Diff> diff_match_patch::diff_main(const std::wstring &text1,
-    const std::wstring &text2, bool checklines, clock_t deadline) {
-  // Check for equality (speedup).
-  std::deque<Diff> diffs;
-  if (text1 == text2) {
-    if (!text1.empty()) {
-      diffs.push_back(Diff(Diff::Operation::Equal, text1));
+// Whether the Levenshtein distance of a and b is at most k, with Myers'
+// bit-vector algorithm.
+static bool levenshteinBitParallel(const wchar_t *a, int m, const wchar_t *b, int n, int k)
+{
+  const int words = (m + 63) / 64;
+  const uint64_t last = uint64_t(1) << ((m - 1) % 64);
+  std::unordered_map<wchar_t, std::vector<uint64_t>> masks;
+  for (int i = 0; i < m; i++) {
+    std::vector<uint64_t> &mask = masks[a[i]];
+    if (mask.empty()) {
+      mask.resize(words);
     }
-    return diffs;
+    mask[i / 64] |= uint64_t(1) << (i % 64);
   }
+  const std::vector<uint64_t> nomatch(words);
 
-  // Trim off common prefix (speedup).
-  int commonlength = diff_commonPrefix(text1, text2);
-  const std::wstring &commonprefix = text1.substr(0, commonlength);
-  std::wstring textChopped1 = text1.substr(commonlength);
-  std::wstring textChopped2 = text2.substr(commonlength);
+  static thread_local std::vector<uint64_t> vectors;
+  const ScratchTrim<uint64_t> trim(vectors);
+  if (vectors.size() < 2 * static_cast<size_t>(words)) {
+    vectors.resize(2 * words);
+  }
+  uint64_t *plus = vectors.data();
+  uint64_t *minus = plus + words;
+  std::fill(plus, plus + words, ~uint64_t(0));
+  std::fill(minus, minus + words, 0);
+  int score = m;
+  for (int j = 0; j < n; j++) {
+    auto found = masks.find(b[j]);
+    // Row 0 of the table counts up by one per column.
+    score += myersColumn(found == masks.end() ? nomatch.data() : found->second.data(),
+                         plus, minus, words, last, 1);
+    // Each column left can bring the distance down by one at most.
+    if (score - (n - j - 1) > k) {
+      return false;
+    }
+  }
+  return score <= k;
+}
 
-  // Trim off common suffix (speedup).
-  commonlength = diff_commonSuffix(textChopped1, textChopped2);
-  const std::wstring &commonsuffix = textChopped1.substr(textChopped1.length() - commonlength);
-  textChopped1 = textChopped1.substr(0, textChopped1.length() - commonlength);
-  textChopped2 = textChopped2.substr(0, textChopped2.length() - commonlength);
 
-  // Compute the diff on the middle block.
-  diffs = diff_compute(textChopped1, textChopped2, checklines, deadline);
+bool diff_match_patch::diff_similarWithin(const std::wstring &text1,
+    const std::wstring &text2, int maxEdits) const {
+  // Trim off the common prefix and suffix, without copying.
+  const wchar_t *begin1 = text1.data();
+  const wchar_t *end1 = begin1 + text1.length();
+  const wchar_t *begin2 = text2.data();
+  const wchar_t *end2 = begin2 + text2.length();
+  while (begin1 != end1 && begin2 != end2 && *begin1 == *begin2) {
+    begin1++;
+    begin2++;
+  }
+  while (begin1 != end1 && begin2 != end2 && end1[-1] == end2[-1]) {
+    end1--;
+    end2--;
+  }
+  int length1 = end1 - begin1;
+  int length2 = end2 - begin2;
+  if (length1 > length2) {
+    std::swap(begin1, begin2);
+    std::swap(length1, length2);
+  }
 
-  // Restore the prefix and suffix.
-  if (!commonprefix.empty()) {
-    diffs.push_front(Diff(Diff::Operation::Equal, commonprefix));
+  // The distance is at least the difference in lengths and at most the
+  // longer length.
+  if (maxEdits < length2 - length1) {
+    return false;
   }
-  if (!commonsuffix.empty()) {
-    diffs.push_back(Diff(Diff::Operation::Equal, commonsuffix));
+  if (maxEdits >= length2) {
+    return true;
   }
+  // A narrow band is cheaper than full columns of bit vectors.
+  if (2 * maxEdits + 1 <= 8 * ((length1 + 63) / 64)) {
+    return levenshteinBanded(begin1, length1, begin2, length2, maxEdits);
+  }
+  return levenshteinBitParallel(begin1, length1, begin2, length2, maxEdits);
+}
 
-  diff_cleanupMerge(diffs);
 
-  return diffs;
+// Counts the lines of one side of a diff, and those which are edited.
+struct LineCounter {
+  long lines = 0;
+  long edited = 0;
+  bool inLine = false;
+  bool lineEdited = false;
+
+  void add(const std::wstring &text, bool edit) {
+    for (wchar_t ch : text) {
+      if (!inLine) {
+        inLine = true;
+        lineEdited = false;
+        lines++;
+      }
+      if (edit && !lineEdited) {
+        lineEdited = true;
+        edited++;
+      }
+      inLine = ch != L'\n';
+    }
+  }
+};
+
+
+DiffStats diff_match_patch::diff_stats(const std::wstring &text1,
+    const std::wstring &text2, bool checklines) const {
+  DiffStats stats;
+  LineCounter counter1;
+  LineCounter counter2;
+  long insertions = 0;
+  long deletions = 0;
+  // Count diff_main's own diffs, so the figures agree with it exactly; the
+  // streaming diff_main splits and cleans up differently.
+  for (const Diff &diff : diff_main(text1, text2, checklines)) {
+    switch (diff.operation) {
+      case Diff::Operation::Insert:
+        stats.hunks += insertions == 0 && deletions == 0;
+        insertions += diff.text.length();
+        stats.insertedChars += diff.text.length();
+        counter2.add(diff.text, true);
+        break;
+      case Diff::Operation::Delete:
+        stats.hunks += insertions == 0 && deletions == 0;
+        deletions += diff.text.length();
+        stats.deletedChars += diff.text.length();
+        counter1.add(diff.text, true);
+        break;
+      case Diff::Operation::Equal:
+        stats.levenshtein += std::max(insertions, deletions);
+        insertions = 0;
+        deletions = 0;
+        stats.equalChars += diff.text.length();
+        counter1.add(diff.text, false);
+        counter2.add(diff.text, false);
+        break;
+    }
+  }
+  stats.levenshtein += std::max(insertions, deletions);
+  stats.lines1 = counter1.lines;
+  stats.lines2 = counter2.lines;
+  stats.deletedLines = counter1.edited;
+  stats.insertedLines = counter2.edited;
+  return stats;
 }
 
 
 std::deque<Diff> diff_match_patch::diff_compute(std::wstring text1, std::wstring text2,
-    bool checklines, clock_t deadline) {
+    bool checklines, clock_t deadline) const {
   std::deque<Diff> diffs;
 
   if (text1.empty()) {
@@ -334,6 +1573,30 @@ std::deque<Diff> diff_match_patch::diff_compute(std::wstring text1, std::wstring
     // Garbage collect longtext and shorttext by scoping out.
   }
 
+  const DiffPlan plan = diff_planCompute(text1, text2, checklines);
+  if (plan.anchored) {
+    // Check to see if the problem can be split around unique lines.
+    const std::vector<LineAnchor> anchors = uniqueLineAnchors(text1, text2);
+    if (!anchors.empty()) {
+      int start1 = 0;
+      int start2 = 0;
+      for (size_t k = 0; k <= anchors.size(); k++) {
+        const int end1 = k < anchors.size() ? anchors[k].start1 : text1.length();
+        const int end2 = k < anchors.size() ? anchors[k].start2 : text2.length();
+        const std::deque<Diff> gap = diff_main(text1.substr(start1, end1 - start1),
+            text2.substr(start2, end2 - start2), checklines, deadline);
+        diffs.insert(diffs.end(), gap.begin(), gap.end());
+        if (k < anchors.size()) {
+          diffs.push_back(Diff(Diff::Operation::Equal,
+                               text1.substr(end1, anchors[k].length)));
+          start1 = end1 + anchors[k].length;
+          start2 = end2 + anchors[k].length;
+        }
+      }
+      return diffs;
+    }
+  }
+
   // Check to see if the problem can be split in two.
   const std::deque<std::wstring> hm = diff_halfMatch(text1, text2);
   if (hm.size() > 0) {
@@ -356,26 +1619,118 @@ std::deque<Diff> diff_match_patch::diff_compute(std::wstring text1, std::wstring
   }
 
   // Perform a real diff.
-  if (checklines && text1.length() > 100 && text2.length() > 100) {
-    return diff_lineMode(text1, text2, deadline);
+  switch (plan.strategy) {
+    case DiffPlan::Strategy::LineMode:
+      return diff_lineMode(text1, text2, deadline);
+    case DiffPlan::Strategy::WordMode:
+      return diff_wordMode(text1, text2, deadline);
+    default:
+      return diff_engine(plan.strategy, text1, text2, deadline);
+  }
+}
+
+
+void diff_match_patch::diff_streamCompute(const std::wstring &text1,
+    const std::wstring &text2, bool checklines, clock_t deadline,
+    const DiffSink &emit) const {
+  if (text1.empty() || text2.empty()) {
+    // Just add or delete some text (speedup).
+    emit(Diff::Operation::Insert, text2);
+    emit(Diff::Operation::Delete, text1);
+    return;
   }
 
-  return diff_bisect(text1, text2, deadline);
+  {
+    const std::wstring &longtext = text1.length() > text2.length() ? text1 : text2;
+    const std::wstring &shorttext = text1.length() > text2.length() ? text2 : text1;
+    const size_t i = longtext.find(shorttext);
+    if (i != std::wstring::npos) {
+      // Shorter text is inside the longer text (speedup).
+      const Diff::Operation op = (text1.length() > text2.length()) ? Diff::Operation::Delete : Diff::Operation::Insert;
+      emit(op, longtext.substr(0, i));
+      emit(Diff::Operation::Equal, shorttext);
+      emit(op, longtext.substr(i + shorttext.length()));
+      return;
+    }
+
+    if (shorttext.length() == 1) {
+      // Single character string.
+      // After the previous speedup, the character can't be an equality.
+      emit(Diff::Operation::Delete, text1);
+      emit(Diff::Operation::Insert, text2);
+      return;
+    }
+  }
+
+  const DiffPlan plan = diff_planCompute(text1, text2, checklines);
+  if (plan.anchored) {
+    // Check to see if the problem can be split around unique lines.
+    const std::vector<LineAnchor> anchors = uniqueLineAnchors(text1, text2);
+    if (!anchors.empty()) {
+      int start1 = 0;
+      int start2 = 0;
+      for (size_t k = 0; k <= anchors.size(); k++) {
+        const int end1 = k < anchors.size() ? anchors[k].start1 : text1.length();
+        const int end2 = k < anchors.size() ? anchors[k].start2 : text2.length();
+        diff_stream(text1.substr(start1, end1 - start1),
+                    text2.substr(start2, end2 - start2), checklines, deadline, emit);
+        if (k < anchors.size()) {
+          emit(Diff::Operation::Equal, text1.substr(end1, anchors[k].length));
+          start1 = end1 + anchors[k].length;
+          start2 = end2 + anchors[k].length;
+        }
+      }
+      return;
+    }
+  }
+
+  // Check to see if the problem can be split in two.
+  const std::deque<std::wstring> hm = diff_halfMatch(text1, text2);
+  if (hm.size() > 0) {
+    // Stream the first half before even looking at the second.
+    diff_stream(hm[0], hm[2], checklines, deadline, emit);
+    emit(Diff::Operation::Equal, hm[4]);
+    diff_stream(hm[1], hm[3], checklines, deadline, emit);
+    return;
+  }
+
+  if (plan.strategy == DiffPlan::Strategy::LineMode) {
+    diff_streamLineMode(text1, text2, deadline, emit);
+    return;
+  }
+
+  // Any other region is only final once it has been merged as a whole.
+  std::deque<Diff> diffs = plan.strategy == DiffPlan::Strategy::WordMode
+      ? diff_wordMode(text1, text2, deadline)
+      : diff_engine(plan.strategy, text1, text2, deadline);
+  diff_cleanupMerge(diffs);
+  for (const Diff &aDiff : diffs) {
+    emit(aDiff.operation, aDiff.text);
+  }
 }
 
 
 std::deque<Diff> diff_match_patch::diff_lineMode(std::wstring text1, std::wstring text2,
-    clock_t deadline) {
+    clock_t deadline) const {
   // Scan the text on a line-by-line basis first.
-  const auto b = diff_linesToChars(text1, text2);
-  text1 = std::get<0>(b);
-  text2 = std::get<1>(b);
-  std::deque<std::wstring> linearray = std::get<2>(b);
+  return diff_tokenMode(diff_linesToChars(text1, text2), deadline);
+}
+
+
+std::deque<Diff> diff_match_patch::diff_wordMode(const std::wstring &text1,
+    const std::wstring &text2, clock_t deadline) const {
+  // Scan the text on a word-by-word basis first.
+  return diff_tokenMode(diff_wordsToChars(text1, text2), deadline);
+}
 
-  std::deque<Diff> diffs = diff_main(text1, text2, false, deadline);
+
+std::deque<Diff> diff_match_patch::diff_tokenMode(
+    const std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> &encoded,
+    clock_t deadline) const {
+  std::deque<Diff> diffs = diff_lines(std::get<0>(encoded), std::get<1>(encoded), deadline);
 
   // Convert the diff back to original text.
-  diff_charsToLines(diffs, linearray);
+  diff_charsToLines(diffs, std::get<2>(encoded));
   // Eliminate freak matches (e.g. blank lines)
   diff_cleanupSemantic(diffs);
 
@@ -431,20 +1786,563 @@ std::deque<Diff> diff_match_patch::diff_lineMode(std::wstring text1, std::wstrin
 }
 
 
+std::deque<Diff> diff_match_patch::diff_lines(const std::wstring &text1,
+    const std::wstring &text2, clock_t deadline) const {
+  if (Diff_Algorithm == DiffAlgorithm::Histogram) {
+    return diff_histogram(text1, text2, deadline);
+  }
+  return diff_main(text1, text2, false, deadline);
+}
+
+
+std::deque<Diff> diff_match_patch::diff_histogram(const std::wstring &text1,
+    const std::wstring &text2, clock_t deadline) const {
+  // Regions still to be diffed, most recent first.  An entry with a negative
+  // start1 is instead an equality of length end1 at start2 of text2 which
+  // sits between two regions.  An explicit stack keeps deep splits (e.g.
+  // reversed lines) off the call stack.
+  struct Region {
+    int start1, end1, start2, end2;
+  };
+  std::deque<Diff> diffs;
+  std::vector<Region> stack(1, Region{0, static_cast<int>(text1.length()),
+                                      0, static_cast<int>(text2.length())});
+  // Occurrences of each line within the current region of text1, as a chain
+  // of positions through `chain` starting at `first`.  Line characters are
+  // small dense integers, so flat arrays beat a hash map here.
+  const size_t alphabet = 1 + std::max(
+      text1.empty() ? 0 : *std::max_element(text1.begin(), text1.end()),
+      text2.empty() ? 0 : *std::max_element(text2.begin(), text2.end()));
+  std::vector<int> first(alphabet, -1);
+  std::vector<int> count(alphabet, 0);
+  std::vector<int> chain(text1.length());
+  while (!stack.empty()) {
+    Region r = stack.back();
+    stack.pop_back();
+    if (r.start1 < 0) {
+      diffs.push_back(Diff(Diff::Operation::Equal, text2.substr(r.start2, r.end1)));
+      continue;
+    }
+
+    // Trim off the common prefix and suffix.
+    int prefix = 0;
+    while (r.start1 + prefix < r.end1 && r.start2 + prefix < r.end2
+           && text1[r.start1 + prefix] == text2[r.start2 + prefix]) {
+      prefix++;
+    }
+    if (prefix > 0) {
+      diffs.push_back(Diff(Diff::Operation::Equal, text1.substr(r.start1, prefix)));
+      r.start1 += prefix;
+      r.start2 += prefix;
+    }
+    int suffix = 0;
+    while (r.start1 < r.end1 - suffix && r.start2 < r.end2 - suffix
+           && text1[r.end1 - suffix - 1] == text2[r.end2 - suffix - 1]) {
+      suffix++;
+    }
+    if (suffix > 0) {
+      r.end1 -= suffix;
+      r.end2 -= suffix;
+      stack.push_back(Region{-1, suffix, r.end2, 0});
+    }
+    if (r.start1 == r.end1 || r.start2 == r.end2) {
+      if (r.start1 < r.end1) {
+        diffs.push_back(Diff(Diff::Operation::Delete, text1.substr(r.start1, r.end1 - r.start1)));
+      }
+      if (r.start2 < r.end2) {
+        diffs.push_back(Diff(Diff::Operation::Insert, text2.substr(r.start2, r.end2 - r.start2)));
+      }
+      continue;
+    }
+
+    // Find the longest common run which contains the rarest lines of text1.
+    int best1 = -1;
+    int best2 = -1;
+    int bestLength = 0;
+    int lowest = Histogram_MaxOccurrences;
+    if (!pastDeadline(deadline)) {
+      for (int i = r.end1 - 1; i >= r.start1; i--) {
+        chain[i] = first[text1[i]];
+        first[text1[i]] = i;
+        count[text1[i]]++;
+      }
+      for (int j = r.start2; j < r.end2;) {
+        int next = j + 1;
+        const wchar_t line = text2[j];
+        if (count[line] > 0 && count[line] <= lowest) {
+          for (int i = first[line]; i != -1; i = chain[i]) {
+            int rarity = count[line];
+            int s1 = i;
+            int s2 = j;
+            while (s1 > r.start1 && s2 > r.start2 && text1[s1 - 1] == text2[s2 - 1]) {
+              s1--;
+              s2--;
+              rarity = std::min(rarity, count[text1[s1]]);
+            }
+            int e1 = i + 1;
+            int e2 = j + 1;
+            while (e1 < r.end1 && e2 < r.end2 && text1[e1] == text2[e2]) {
+              rarity = std::min(rarity, count[text1[e1]]);
+              e1++;
+              e2++;
+            }
+            next = std::max(next, e2);
+            if (e1 - s1 > bestLength || rarity < lowest) {
+              best1 = s1;
+              best2 = s2;
+              bestLength = e1 - s1;
+              lowest = rarity;
+            }
+          }
+        }
+        j = next;
+      }
+      for (int i = r.start1; i < r.end1; i++) {
+        first[text1[i]] = -1;
+        count[text1[i]] = 0;
+      }
+    }
+
+    if (bestLength == 0) {
+      // No line is rare enough to anchor on, fall back to Myers.
+      const std::deque<Diff> rest = diff_main(
+          text1.substr(r.start1, r.end1 - r.start1),
+          text2.substr(r.start2, r.end2 - r.start2), false, deadline);
+      diffs.insert(diffs.end(), rest.begin(), rest.end());
+      continue;
+    }
+    // Diff either side of the anchor, left first.
+    stack.push_back(Region{best1 + bestLength, r.end1, best2 + bestLength, r.end2});
+    stack.push_back(Region{-1, bestLength, best2, 0});
+    stack.push_back(Region{r.start1, best1, r.start2, best2});
+  }
+  diff_cleanupMerge(diffs);
+  return diffs;
+}
+
+
+void diff_match_patch::diff_streamLineMode(const std::wstring &text1,
+    const std::wstring &text2, clock_t deadline, const DiffSink &emit) const {
+  // Scan the text on a line-by-line basis first.  The line-level diff is
+  // kept encoded, one character per line, and only the block at hand is
+  // ever converted back to original text.
+  const auto b = diff_linesToChars(text1, text2);
+  const std::deque<std::wstring> &lineArray = std::get<2>(b);
+  std::deque<Diff> diffs = diff_lines(std::get<0>(b), std::get<1>(b), deadline);
+
+  // Eliminate freak matches (e.g. blank lines), weighing lines alike.
+  diff_cleanupSemantic(diffs);
+
+  auto lines = [&lineArray](const std::wstring &chars) {
+    std::wstring text;
+    for (wchar_t c : chars) {
+      text += lineArray[static_cast<unsigned short>(c)];
+    }
+    return text;
+  };
+
+  // Rediff any replacement blocks, this time character-by-character, and
+  // release each one to the sink before moving on to the next.
+  diffs.push_back(Diff(Diff::Operation::Equal, L""));
+  std::wstring chars_delete;
+  std::wstring chars_insert;
+  for (const Diff &aDiff : diffs) {
+    switch (aDiff.operation) {
+      case Diff::Operation::Insert:
+        chars_insert += aDiff.text;
+        break;
+      case Diff::Operation::Delete:
+        chars_delete += aDiff.text;
+        break;
+      case Diff::Operation::Equal:
+        if (!chars_delete.empty() && !chars_insert.empty()) {
+          for (const Diff &newDiff : diff_main(lines(chars_delete), lines(chars_insert), false, deadline)) {
+            emit(newDiff.operation, newDiff.text);
+          }
+        } else {
+          emit(Diff::Operation::Delete, lines(chars_delete));
+          emit(Diff::Operation::Insert, lines(chars_insert));
+        }
+        emit(Diff::Operation::Equal, lines(aDiff.text));
+        chars_delete.clear();
+        chars_insert.clear();
+        break;
+    }
+  }
+}
+
+
+DiffPlan diff_match_patch::diff_plan(const std::wstring &text1,
+    const std::wstring &text2, bool checklines) const {
+  // Trim off the common prefix and suffix, as diff_main does.
+  const int prefix = diff_commonPrefix(text1, text2);
+  const int suffix = diff_commonSuffix(text1.substr(prefix), text2.substr(prefix));
+  const std::wstring rest1 = text1.substr(prefix, text1.length() - prefix - suffix);
+  const std::wstring rest2 = text2.substr(prefix, text2.length() - prefix - suffix);
+
+  const std::wstring &longtext = rest1.length() > rest2.length() ? rest1 : rest2;
+  const std::wstring &shorttext = rest1.length() > rest2.length() ? rest2 : rest1;
+  if (shorttext.length() <= 1 || longtext.find(shorttext) != std::wstring::npos) {
+    DiffPlan plan;
+    plan.length1 = rest1.length();
+    plan.length2 = rest2.length();
+    plan.reason = L"one text is empty, a single character or inside the other";
+    return plan;
+  }
+  return diff_planCompute(rest1, rest2, checklines);
+}
+
+
+// Share of (up to 64 evenly spaced) lines of text1 which occur in text2.
+static float sampleLineSimilarity(const std::wstring &text1,
+                                  const std::wstring &text2)
+{
+  const std::vector<int> lines1 = lineStarts(text1);
+  const std::vector<int> lines2 = lineStarts(text2);
+  std::unordered_map<uint64_t, int> hashes2;
+  for (size_t j = 0; j + 1 < lines2.size(); j++) {
+    hashes2[hashRange(text2, lines2[j], lines2[j + 1])]++;
+  }
+  const size_t count1 = lines1.size() - 1;
+  const size_t samples = std::min<size_t>(count1, 64);
+  int found = 0;
+  for (size_t k = 0; k < samples; k++) {
+    const size_t i = k * count1 / samples;
+    found += hashes2.count(hashRange(text1, lines1[i], lines1[i + 1])) != 0;
+  }
+  return samples == 0 ? 0 : static_cast<float>(found) / samples;
+}
+
+// Distinct characters among (up to 1024 evenly spaced) characters of each
+// text.
+static int sampleAlphabet(const std::wstring &text1, const std::wstring &text2)
+{
+  std::vector<wchar_t> seen;
+  for (const std::wstring *text : {&text1, &text2}) {
+    const size_t samples = std::min<size_t>(text->length(), 1024);
+    for (size_t k = 0; k < samples; k++) {
+      seen.push_back((*text)[k * text->length() / samples]);
+    }
+  }
+  std::sort(seen.begin(), seen.end());
+  return std::unique(seen.begin(), seen.end()) - seen.begin();
+}
+
+
+DiffPlan diff_match_patch::diff_planCompute(const std::wstring &text1,
+    const std::wstring &text2, bool checklines) const {
+  DiffPlan plan;
+  plan.length1 = text1.length();
+  plan.length2 = text2.length();
+  plan.anchored = Diff_Anchoring;
+  plan.halfMatch = Diff_Timeout > 0;
+
+  const int64_t cells = static_cast<int64_t>(plan.length1) * plan.length2;
+  const int shorter = std::min(plan.length1, plan.length2);
+  const int longer = std::max(plan.length1, plan.length2);
+  const bool lopsided = longer >= Diff_ONPRatio * shorter;
+  const bool longTexts = plan.length1 > Diff_LineModeLength
+      && plan.length2 > Diff_LineModeLength;
+
+  if (Diff_Algorithm != DiffAlgorithm::Auto) {
+    // The fixed rules: line mode for long texts, then the cheapest engine
+    // that gives the same quality of diff.
+    if (checklines && longTexts) {
+      plan.strategy = DiffPlan::Strategy::LineMode;
+      plan.reason = L"both texts are longer than "
+          + std::to_wstring(Diff_LineModeLength) + L" characters";
+    } else if (Diff_Algorithm == DiffAlgorithm::ONP) {
+      plan.strategy = DiffPlan::Strategy::ONP;
+      plan.reason = L"O(NP) was asked for";
+    } else if (cells <= Diff_BitParallelCells) {
+      plan.strategy = DiffPlan::Strategy::BitParallel;
+      plan.reason = L"the texts are small enough for bit vectors";
+    } else if (lopsided) {
+      plan.strategy = DiffPlan::Strategy::ONP;
+      plan.reason = L"one text is much longer than the other";
+    } else {
+      plan.strategy = DiffPlan::Strategy::Bisect;
+      plan.reason = L"no faster engine applies";
+    }
+    return plan;
+  }
+
+  // The texts themselves are only looked at while a line-level decision is
+  // still open.  Below that, as in every region a character-level diff
+  // recurses into, planning takes constant time.
+  if (checklines) {
+    plan.lines1 = std::count(text1.begin(), text1.end(), L'\n') + 1;
+    plan.lines2 = std::count(text2.begin(), text2.end(), L'\n') + 1;
+  }
+  if (checklines && longTexts) {
+    plan.alphabet = sampleAlphabet(text1, text2);
+  }
+  const bool tokens = checklines && longTexts
+      && plan.alphabet >= Diff_MinTokenAlphabet;
+  const int lineLength = tokens ? (plan.length1 + plan.length2) / (plan.lines1 + plan.lines2) : 0;
+  if (cells <= Diff_BitParallelCells) {
+    plan.strategy = DiffPlan::Strategy::BitParallel;
+    plan.reason = L"the texts are small enough for bit vectors";
+  } else if (lopsided) {
+    plan.strategy = DiffPlan::Strategy::ONP;
+    plan.reason = L"one text is much longer than the other";
+  } else if (tokens && lineLength > Diff_WordModeLineLength) {
+    plan.strategy = DiffPlan::Strategy::WordMode;
+    plan.reason = L"lines average " + std::to_wstring(lineLength)
+        + L" characters, too long to align";
+  } else if (tokens) {
+    plan.strategy = DiffPlan::Strategy::LineMode;
+    plan.reason = L"both texts are longer than "
+        + std::to_wstring(Diff_LineModeLength) + L" characters";
+  } else {
+    plan.strategy = DiffPlan::Strategy::Bisect;
+    plan.reason = checklines && longTexts
+        ? L"only " + std::to_wstring(plan.alphabet)
+          + L" distinct characters, too few to split into lines or words"
+        : L"no faster engine applies";
+  }
+
+  // Large line-structured texts which share most of their lines fall apart
+  // into small problems around the lines they have once each.
+  if (!plan.anchored && checklines
+      && plan.strategy != DiffPlan::Strategy::BitParallel
+      && plan.strategy != DiffPlan::Strategy::ONP
+      && plan.lines1 >= Diff_AnchorMinLines && plan.lines2 >= Diff_AnchorMinLines) {
+    plan.lineSimilarity = sampleLineSimilarity(text1, text2);
+    if (plan.lineSimilarity >= Diff_AnchorSimilarity) {
+      plan.anchored = true;
+      plan.reason += L"; most lines are shared, so split around unique ones";
+    }
+  }
+  return plan;
+}
+
+
+std::deque<Diff> diff_match_patch::diff_engine(DiffPlan::Strategy strategy,
+    const std::wstring &text1, const std::wstring &text2,
+    clock_t deadline) const {
+  switch (strategy) {
+    case DiffPlan::Strategy::BitParallel:
+      return diff_bitParallel(text1, text2, deadline);
+    case DiffPlan::Strategy::ONP:
+      return diff_onp(text1, text2, deadline);
+    default:
+      return diff_bisect(text1, text2, deadline);
+  }
+}
+
+
+std::deque<Diff> diff_match_patch::diff_onp(const std::wstring &text1,
+    const std::wstring &text2, clock_t deadline) const {
+  // The algorithm wants the shorter text first; swap and swap back.
+  const bool swapped = text1.length() > text2.length();
+  const std::wstring &a = swapped ? text2 : text1;
+  const std::wstring &b = swapped ? text1 : text2;
+  const int m = a.length();
+  const int n = b.length();
+  const int delta = n - m;
+
+  // Every snake walked is remembered with the one it extends, so that the
+  // edit path can be read back.  fp[k] is the furthest y reached on diagonal
+  // k = y - x, and path[k] the snake which got there.
+  struct Snake {
+    int x;       // Start of the run of equalities.
+    int y;
+    int length;  // Number of equalities.
+    int previous;
+  };
+  std::vector<Snake> snakes;
+  const int offset = m + 1;
+  std::vector<int> fp(m + n + 3, -1);
+  std::vector<int> path(m + n + 3, -1);
+  auto snake = [&](int k) {
+    const int down = fp[offset + k - 1] + 1;
+    const int right = fp[offset + k + 1];
+    int y = std::max(down, right);
+    const int previous = down > right ? path[offset + k - 1] : path[offset + k + 1];
+    const int x0 = y - k;
+    const int y0 = y;
+    int x = x0;
+    while (x < m && y < n && a[x] == b[y]) {
+      x++;
+      y++;
+    }
+    path[offset + k] = snakes.size();
+    snakes.push_back(Snake{x0, y0, x - x0, previous});
+    fp[offset + k] = y;
+  };
+
+  for (int p = 0; fp[offset + delta] != n; p++) {
+    if (pastDeadline(deadline) || snakes.size() > ONP_MaxPath) {
+      return diff_bisect(text1, text2, deadline);
+    }
+    for (int k = -p; k < delta; k++) {
+      snake(k);
+    }
+    for (int k = delta + p; k > delta; k--) {
+      snake(k);
+    }
+    snake(delta);
+  }
+
+  // Read the path back to front, then replay it.
+  std::vector<int> chain;
+  for (int s = path[offset + delta]; s != -1; s = snakes[s].previous) {
+    chain.push_back(s);
+  }
+  const Diff::Operation deleteA = swapped ? Diff::Operation::Insert : Diff::Operation::Delete;
+  const Diff::Operation insertB = swapped ? Diff::Operation::Delete : Diff::Operation::Insert;
+  std::deque<Diff> diffs;
+  auto append = [&diffs](Diff::Operation op, const std::wstring &text) {
+    if (text.empty()) {
+      return;
+    }
+    if (!diffs.empty() && diffs.back().operation == op) {
+      diffs.back().text += text;
+    } else {
+      diffs.push_back(Diff(op, text));
+    }
+  };
+  int x = 0;
+  int y = 0;
+  for (auto s = chain.rbegin(); s != chain.rend(); ++s) {
+    const Snake &step = snakes[*s];
+    // Each snake starts one deletion or insertion after the last one ended.
+    append(deleteA, a.substr(x, step.x - x));
+    append(insertB, b.substr(y, step.y - y));
+    append(Diff::Operation::Equal, a.substr(step.x, step.length));
+    x = step.x + step.length;
+    y = step.y + step.length;
+  }
+  // Runs of alternating deletions and insertions come out in path order.
+  diff_cleanupMerge(diffs);
+  return diffs;
+}
+
+
+std::deque<Diff> diff_match_patch::diff_bitParallel(const std::wstring &text1,
+    const std::wstring &text2, clock_t deadline) const {
+  const int length1 = text1.length();
+  const int length2 = text2.length();
+  const int words = (length1 + 63) / 64;
+  // The table is built over the reversed texts, so that walking back through
+  // it runs forwards through the originals and, like diff_bisect, takes the
+  // earliest matches.
+  const std::wstring reversed1(text1.rbegin(), text1.rend());
+  const std::wstring reversed2(text2.rbegin(), text2.rend());
+
+  // Bit i of the mask of a character is set where reversed1[i] is that
+  // character.
+  std::unordered_map<wchar_t, std::vector<uint64_t>> masks;
+  for (int i = 0; i < length1; i++) {
+    std::vector<uint64_t> &mask = masks[reversed1[i]];
+    if (mask.empty()) {
+      mask.resize(words);
+    }
+    mask[i / 64] |= uint64_t(1) << (i % 64);
+  }
+
+  // Row j describes the LCS table after j characters of reversed2: a clear
+  // bit i means the LCS grows by one between columns i and i + 1.  The rows
+  // live in a per-thread buffer which is reused from call to call.
+  static thread_local std::vector<uint64_t> rows;
+  const ScratchTrim<uint64_t> trim(rows);
+  if (rows.size() < (length2 + 1) * static_cast<size_t>(words)) {
+    rows.resize((length2 + 1) * static_cast<size_t>(words));
+  }
+  std::fill(rows.begin(), rows.begin() + words, ~uint64_t(0));
+  for (int j = 1; j <= length2; j++) {
+    if ((j - 1) % 256 == 0 && pastDeadline(deadline)) {
+      // Out of time, as diff_bisect would be.
+      std::deque<Diff> diffs;
+      diffs.push_back(Diff(Diff::Operation::Delete, text1));
+      diffs.push_back(Diff(Diff::Operation::Insert, text2));
+      return diffs;
+    }
+    const uint64_t *previous = &rows[(j - 1) * static_cast<size_t>(words)];
+    uint64_t *row = &rows[j * static_cast<size_t>(words)];
+    auto found = masks.find(reversed2[j - 1]);
+    if (found == masks.end()) {
+      std::copy(previous, previous + words, row);
+      continue;
+    }
+    const uint64_t *mask = found->second.data();
+    uint64_t carry = 0;
+    for (int w = 0; w < words; w++) {
+      const uint64_t v = previous[w];
+      const uint64_t u = v & mask[w];
+      const uint64_t partial = v + u;
+      const uint64_t sum = partial + carry;
+      carry = (partial < v) | (sum < partial);
+      row[w] = sum | (v & ~mask[w]);
+    }
+  }
+
+  // Walk back from the bottom right corner.  Matching characters are always
+  // on some longest path; otherwise a set bit means column i - 1 is as good,
+  // and deletions are preferred.
+  std::deque<Diff> diffs;
+  int i = length1;
+  int j = length2;
+  while (i > 0 || j > 0) {
+    Diff::Operation op;
+    if (i > 0 && j > 0 && reversed1[i - 1] == reversed2[j - 1]) {
+      op = Diff::Operation::Equal;
+    } else if (i > 0 && (j == 0
+        || (rows[j * static_cast<size_t>(words) + (i - 1) / 64] >> ((i - 1) % 64)) & 1)) {
+      op = Diff::Operation::Delete;
+    } else {
+      op = Diff::Operation::Insert;
+    }
+    const wchar_t c = op == Diff::Operation::Insert ? reversed2[j - 1] : reversed1[i - 1];
+    if (diffs.empty() || diffs.back().operation != op) {
+      diffs.push_back(Diff(op, L""));
+    }
+    diffs.back().text += c;
+    if (op != Diff::Operation::Insert) {
+      i--;
+    }
+    if (op != Diff::Operation::Delete) {
+      j--;
+    }
+  }
+  return diffs;
+}
+
+
 std::deque<Diff> diff_match_patch::diff_bisect(const std::wstring &text1,
-    const std::wstring &text2, clock_t deadline) {
+    const std::wstring &text2, clock_t deadline) const {
+  int x, y;
+  if (diff_bisectMiddle(text1, text2, (text1.length() + text2.length() + 1) / 2,
+                        deadline, x, y) >= 0) {
+    return diff_bisectSplit(text1, text2, x, y, deadline);
+  }
+  // Diff took too long and hit the deadline or
+  // number of diffs equals number of characters, no commonality at all.
+  std::deque<Diff> diffs;
+  diffs.push_back(Diff(Diff::Operation::Delete, text1));
+  diffs.push_back(Diff(Diff::Operation::Insert, text2));
+  return diffs;
+}
+
+int diff_match_patch::diff_bisectMiddle(const std::wstring &text1,
+    const std::wstring &text2, int max_d, clock_t deadline, int &x, int &y) const {
   // Cache the text lengths to prevent multiple calls.
   const int text1_length = text1.length();
   const int text2_length = text2.length();
-  const int max_d = (text1_length + text2_length + 1) / 2;
   const int v_offset = max_d;
   const int v_length = 2 * max_d;
-  std::vector<int> v1(v_length);
-  std::vector<int> v2(v_length);
-  for (int x = 0; x < v_length; x++) {
-    v1[x] = -1;
-    v2[x] = -1;
+  // Both paths live in a per-thread buffer which is reused from call to
+  // call, unless this call left it oversized.  Recursion only happens on
+  // the way out, once they are done with.
+  static thread_local std::vector<int> scratch;
+  const ScratchTrim<int> trim(scratch);
+  if (scratch.size() < 2 * static_cast<size_t>(v_length)) {
+    scratch.resize(2 * v_length);
   }
+  int *v1 = scratch.data();
+  int *v2 = v1 + v_length;
+  std::fill(v1, v2 + v_length, -1);
   v1[v_offset + 1] = 0;
   v2[v_offset + 1] = 0;
   const int delta = text1_length - text2_length;
@@ -459,7 +2357,7 @@ std::deque<Diff> diff_match_patch::diff_bisect(const std::wstring &text1,
   int k2end = 0;
   for (int d = 0; d < max_d; d++) {
     // Bail out if deadline is reached.
-    if (clock() > deadline) {
+    if (pastDeadline(deadline)) {
       break;
     }
 
@@ -492,7 +2390,9 @@ std::deque<Diff> diff_match_patch::diff_bisect(const std::wstring &text1,
           int x2 = text1_length - v2[k2_offset];
           if (x1 >= x2) {
             // Overlap detected.
-            return diff_bisectSplit(text1, text2, x1, y1, deadline);
+            x = x1;
+            y = y1;
+            return 2 * d - 1;
           }
         }
       }
@@ -529,22 +2429,19 @@ std::deque<Diff> diff_match_patch::diff_bisect(const std::wstring &text1,
           x2 = text1_length - x2;
           if (x1 >= x2) {
             // Overlap detected.
-            return diff_bisectSplit(text1, text2, x1, y1, deadline);
+            x = x1;
+            y = y1;
+            return 2 * d;
           }
         }
       }
     }
   }
-  // Diff took too long and hit the deadline or
-  // number of diffs equals number of characters, no commonality at all.
-  std::deque<Diff> diffs;
-  diffs.push_back(Diff(Diff::Operation::Delete, text1));
-  diffs.push_back(Diff(Diff::Operation::Insert, text2));
-  return diffs;
+  return -1;
 }
 
 std::deque<Diff> diff_match_patch::diff_bisectSplit(const std::wstring &text1,
-    const std::wstring &text2, int x, int y, clock_t deadline) {
+    const std::wstring &text2, int x, int y, clock_t deadline) const {
   std::wstring text1a = text1.substr(0, x);
   std::wstring text2a = text2.substr(0, y);
   std::wstring text1b = text1.substr(x);
@@ -559,7 +2456,7 @@ std::deque<Diff> diff_match_patch::diff_bisectSplit(const std::wstring &text1,
 }
 
 std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> diff_match_patch::diff_linesToChars(const std::wstring &text1,
-                                                    const std::wstring &text2) {
+                                                    const std::wstring &text2) const {
   std::deque<std::wstring> lineArray;
   std::map<std::wstring, int> lineHash;
   // e.g. linearray[4] == "Hello\n"
@@ -578,7 +2475,7 @@ std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> diff_match_patc
 
 std::wstring diff_match_patch::diff_linesToCharsMunge(const std::wstring &text,
                                                  std::deque<std::wstring> &lineArray,
-                                                 std::map<std::wstring, int> &lineHash) {
+                                                 std::map<std::wstring, int> &lineHash) const {
   int lineStart = 0;
   int lineEnd = -1;
   std::wstring line;
@@ -602,13 +2499,56 @@ std::wstring diff_match_patch::diff_linesToCharsMunge(const std::wstring &text,
       chars += wchar_t(static_cast<unsigned short>(lineArray.size() - 1));
     }
   }
-  return chars;
+  return chars;
+}
+
+
+
+std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> diff_match_patch::diff_wordsToChars(
+    const std::wstring &text1, const std::wstring &text2) const {
+  std::deque<std::wstring> wordArray;
+  std::unordered_map<std::wstring, int> wordHash;
+  // Skip the null character, as diff_linesToChars does.
+  wordArray.push_back(L"");
+
+  std::wstring chars[2];
+  const std::wstring *texts[2] = {&text1, &text2};
+  for (int t = 0; t < 2; t++) {
+    const std::wstring &text = *texts[t];
+    size_t start = 0;
+    while (start < text.length()) {
+      // A word is a run of letters and digits, a run of whitespace, or any
+      // other single character.
+      size_t end = start + 1;
+      if (std::iswalnum(text[start]) || text[start] == L'_') {
+        while (end < text.length() && (std::iswalnum(text[end]) || text[end] == L'_')) {
+          end++;
+        }
+      } else if (std::iswspace(text[start])) {
+        while (end < text.length() && std::iswspace(text[end])) {
+          end++;
+        }
+      }
+      if (wordArray.size() == 0xffff) {
+        // Out of characters to encode with; the rest is one last word.
+        end = text.length();
+      }
+      const std::wstring word = text.substr(start, end - start);
+      auto found = wordHash.find(word);
+      if (found == wordHash.end()) {
+        wordArray.push_back(word);
+        found = wordHash.emplace(word, wordArray.size() - 1).first;
+      }
+      chars[t] += wchar_t(static_cast<unsigned short>(found->second));
+      start = end;
+    }
+  }
+  return std::make_tuple(chars[0], chars[1], wordArray);
 }
 
 
-
 void diff_match_patch::diff_charsToLines(std::deque<Diff> &diffs,
-                                         const std::deque<std::wstring> &lineArray) {
+                                         const std::deque<std::wstring> &lineArray) const {
   for (Diff &diff : diffs)
   {
     std::wstring text;
@@ -622,7 +2562,7 @@ void diff_match_patch::diff_charsToLines(std::deque<Diff> &diffs,
 
 
 int diff_match_patch::diff_commonPrefix(const std::wstring &text1,
-                                        const std::wstring &text2) {
+                                        const std::wstring &text2) const {
   // Performance analysis: http://neil.fraser.name/news/2007/10/09/
   const int n = std::min(text1.length(), text2.length());
   for (int i = 0; i < n; i++) {
@@ -635,7 +2575,7 @@ int diff_match_patch::diff_commonPrefix(const std::wstring &text1,
 
 
 int diff_match_patch::diff_commonSuffix(const std::wstring &text1,
-                                        const std::wstring &text2) {
+                                        const std::wstring &text2) const {
   // Performance analysis: http://neil.fraser.name/news/2007/10/09/
   const int text1_length = text1.length();
   const int text2_length = text2.length();
@@ -649,7 +2589,7 @@ int diff_match_patch::diff_commonSuffix(const std::wstring &text1,
 }
 
 int diff_match_patch::diff_commonOverlap(const std::wstring &text1,
-                                         const std::wstring &text2) {
+                                         const std::wstring &text2) const {
   // Cache the text lengths to prevent multiple calls.
   const int text1_length = text1.length();
   const int text2_length = text2.length();
@@ -691,7 +2631,7 @@ int diff_match_patch::diff_commonOverlap(const std::wstring &text1,
 }
 
 std::deque<std::wstring> diff_match_patch::diff_halfMatch(const std::wstring &text1,
-                                             const std::wstring &text2) {
+                                             const std::wstring &text2) const {
   if (Diff_Timeout <= 0) {
     // Don't risk returning a non-optimal diff if we have unlimited time.
     return std::deque<std::wstring>();
@@ -733,7 +2673,7 @@ std::deque<std::wstring> diff_match_patch::diff_halfMatch(const std::wstring &te
 
 std::deque<std::wstring> diff_match_patch::diff_halfMatchI(const std::wstring &longtext,
                                               const std::wstring &shorttext,
-                                              int i) {
+                                              int i) const {
   // Start with a 1/4 length substring at position i as a seed.
   const std::wstring seed = longtext.substr(i, longtext.length() / 4);
   int j = -1;
@@ -763,7 +2703,60 @@ std::deque<std::wstring> diff_match_patch::diff_halfMatchI(const std::wstring &l
 }
 
 
-void diff_match_patch::diff_cleanupSemantic(std::deque<Diff> &diffs) {
+DiffHunks diff_match_patch::diff_hunks(std::wstring text1, std::wstring text2) const {
+  return DiffHunks(*this, std::move(text1), std::move(text2));
+}
+
+
+Patch diff_match_patch::diff_window(const std::wstring &text1,
+                                   const std::wstring &text2,
+                                   int start1, int length1) const {
+  const LineCounts counts(text1, text2);
+  const std::vector<int> &lines1 = counts.lines1;
+  const std::vector<int> &lines2 = counts.lines2;
+  const int count1 = lines1.size() - 1;
+  const int count2 = lines2.size() - 1;
+
+  // Widen the window to whole lines.
+  start1 = std::max(0, std::min(start1, static_cast<int>(text1.length())));
+  const int end1 = std::max(start1, std::min(start1 + length1, static_cast<int>(text1.length())));
+  int first1 = std::upper_bound(lines1.begin(), lines1.end() - 1, start1) - lines1.begin() - 1;
+  int last1 = std::lower_bound(lines1.begin(), lines1.end() - 1, end1) - lines1.begin();
+  first1 = std::max(0, std::min(first1, count1));
+  last1 = std::max(first1, std::min(last1, count1));
+
+  // Walk outwards to the nearest anchors on either side.
+  int first2 = 0;
+  while (first1 > 0) {
+    const int j = counts.anchor(first1 - 1);
+    if (j != -1) {
+      first2 = j + 1;
+      break;
+    }
+    first1--;
+  }
+  int last2 = count2;
+  while (last1 < count1) {
+    const int j = counts.anchor(last1);
+    if (j >= first2) {
+      last2 = j;
+      break;
+    }
+    last1++;
+  }
+
+  Patch patch;
+  patch.start1 = lines1[first1];
+  patch.start2 = lines2[first2];
+  patch.length1 = lines1[last1] - patch.start1;
+  patch.length2 = lines2[last2] - patch.start2;
+  patch.diffs = diff_main(text1.substr(patch.start1, patch.length1),
+                          text2.substr(patch.start2, patch.length2));
+  return patch;
+}
+
+
+void diff_match_patch::diff_cleanupSemantic(std::deque<Diff> &diffs) const {
   if (diffs.empty()) {
     return;
   }
@@ -906,7 +2899,7 @@ void diff_match_patch::diff_cleanupSemantic(std::deque<Diff> &diffs) {
 }
 
 
-void diff_match_patch::diff_cleanupSemanticLossless(std::deque<Diff> &diffs) {
+void diff_match_patch::diff_cleanupSemanticLossless(std::deque<Diff> &diffs) const {
   if (diffs.size() < 3)
     return;
   std::wstring equality1, edit, equality2;
@@ -985,7 +2978,7 @@ void diff_match_patch::diff_cleanupSemanticLossless(std::deque<Diff> &diffs) {
 
 
 int diff_match_patch::diff_cleanupSemanticScore(const std::wstring &one,
-                                                const std::wstring &two) {
+                                                const std::wstring &two) const {
   if (one.empty() || two.empty()) {
     // Edges are the best.
     return 6;
@@ -1028,11 +3021,11 @@ int diff_match_patch::diff_cleanupSemanticScore(const std::wstring &one,
 
 
 // Define some regex patterns for matching boundaries.
-std::wregex diff_match_patch::BLANKLINEEND(L"\\n\\r?\\n$");
-std::wregex diff_match_patch::BLANKLINESTART(L"^\\r?\\n\\r?\\n");
+const std::wregex diff_match_patch::BLANKLINEEND(L"\\n\\r?\\n$");
+const std::wregex diff_match_patch::BLANKLINESTART(L"^\\r?\\n\\r?\\n");
 
 
-void diff_match_patch::diff_cleanupEfficiency(std::deque<Diff> &diffs) {
+void diff_match_patch::diff_cleanupEfficiency(std::deque<Diff> &diffs) const {
   if (diffs.empty()) {
     return;
   }
@@ -1140,7 +3133,7 @@ void diff_match_patch::diff_cleanupEfficiency(std::deque<Diff> &diffs) {
 }
 
 
-void diff_match_patch::diff_cleanupMerge(std::deque<Diff> &diffs) {
+void diff_match_patch::diff_cleanupMerge(std::deque<Diff> &diffs) const {
   diffs.push_back(Diff(Diff::Operation::Equal, L""));  // Add a dummy entry at the end.
   int count_delete = 0;
   int count_insert = 0;
@@ -1282,7 +3275,7 @@ void diff_match_patch::diff_cleanupMerge(std::deque<Diff> &diffs) {
 }
 
 
-int diff_match_patch::diff_xIndex(const std::deque<Diff> &diffs, int loc) {
+int diff_match_patch::diff_xIndex(const std::deque<Diff> &diffs, int loc) const {
   int chars1 = 0;
   int chars2 = 0;
   int last_chars1 = 0;
@@ -1314,7 +3307,7 @@ int diff_match_patch::diff_xIndex(const std::deque<Diff> &diffs, int loc) {
 }
 
 
-std::wstring diff_match_patch::diff_prettyHtml(const std::deque<Diff> &diffs) {
+std::wstring diff_match_patch::diff_prettyHtml(const std::deque<Diff> &diffs) const {
   std::wstring html;
   std::wstring text;
   for (const Diff& aDiff : diffs) {
@@ -1341,7 +3334,7 @@ std::wstring diff_match_patch::diff_prettyHtml(const std::deque<Diff> &diffs) {
 }
 
 
-std::wstring diff_match_patch::diff_text1(const std::deque<Diff> &diffs) {
+std::wstring diff_match_patch::diff_text1(const std::deque<Diff> &diffs) const {
   std::wstring text;
   for (const Diff& aDiff : diffs) {
     if (aDiff.operation != Diff::Operation::Insert) {
@@ -1352,7 +3345,7 @@ std::wstring diff_match_patch::diff_text1(const std::deque<Diff> &diffs) {
 }
 
 
-std::wstring diff_match_patch::diff_text2(const std::deque<Diff> &diffs) {
+std::wstring diff_match_patch::diff_text2(const std::deque<Diff> &diffs) const {
   std::wstring text;
   for (const Diff& aDiff : diffs) {
     if (aDiff.operation != Diff::Operation::Delete) {
@@ -1363,7 +3356,7 @@ std::wstring diff_match_patch::diff_text2(const std::deque<Diff> &diffs) {
 }
 
 
-int diff_match_patch::diff_levenshtein(const std::deque<Diff> &diffs) {
+int diff_match_patch::diff_levenshtein(const std::deque<Diff> &diffs) const {
   int levenshtein = 0;
   int insertions = 0;
   int deletions = 0;
@@ -1388,7 +3381,7 @@ int diff_match_patch::diff_levenshtein(const std::deque<Diff> &diffs) {
 }
 
 
-std::wstring diff_match_patch::diff_toDelta(const std::deque<Diff> &diffs) {
+std::wstring diff_match_patch::diff_toDelta(const std::deque<Diff> &diffs) const {
   std::wstring text;
   for (const Diff& aDiff : diffs) {
     switch (aDiff.operation) {
@@ -1416,7 +3409,7 @@ std::wstring diff_match_patch::diff_toDelta(const std::deque<Diff> &diffs) {
 
 
 std::deque<Diff> diff_match_patch::diff_fromDelta(const std::wstring &text1,
-                                             const std::wstring &delta) {
+                                             const std::wstring &delta) const {
   std::deque<Diff> diffs;
   int pointer = 0;  // Cursor in text1
   std::deque<std::wstring> tokens;
@@ -1465,44 +3458,847 @@ std::deque<Diff> diff_match_patch::diff_fromDelta(const std::wstring &text1,
   if (pointer != text1.length()) {
     throw static_cast<std::wstringstream &>(std::wstringstream(L"Delta length (").flush() << pointer << L") smaller than source text length (" << text1.length() << L")").str();
   }
-  return diffs;
+  return diffs;
+}
+
+
+  //  MATCH FUNCTIONS
+
+
+int diff_match_patch::match_main(const std::wstring &text, const std::wstring &pattern,
+                                 int loc) const
+{
+  loc = std::max((size_t)0, std::min((size_t)loc, text.length()));
+  if (text == pattern) {
+    // Shortcut (potentially not guaranteed by the algorithm)
+    return 0;
+  } else if (text.empty()) {
+    // Nothing to match.
+    return -1;
+  } else if (loc + pattern.length() <= text.length()
+      && text.substr(loc, pattern.length()) == pattern) {
+    // Perfect match at the perfect spot!  (Includes case of null pattern)
+    return loc;
+  } else {
+    // Do a fuzzy compare.
+    const MatchPattern compiled(pattern);
+    if (Match_Algorithm == MatchAlgorithm::Myers) {
+      return match_myers(text, compiled, loc);
+    }
+    return match_bitap(text, compiled, loc);
+  }
+}
+
+
+int diff_match_patch::match_main(const std::wstring &text, const MatchPattern &compiled,
+                                 int loc) const
+{
+  const std::wstring &pattern = compiled.text();
+  loc = std::max((size_t)0, std::min((size_t)loc, text.length()));
+  if (text == pattern) {
+    // Shortcut (potentially not guaranteed by the algorithm)
+    return 0;
+  } else if (text.empty()) {
+    // Nothing to match.
+    return -1;
+  } else if (loc + pattern.length() <= text.length()
+      && text.compare(loc, pattern.length(), pattern) == 0) {
+    // Perfect match at the perfect spot!  (Includes case of null pattern)
+    return loc;
+  } else {
+    // Do a fuzzy compare.
+    if (Match_Algorithm == MatchAlgorithm::Myers) {
+      return match_myers(text, compiled, loc);
+    }
+    return match_bitap(text, compiled, loc);
+  }
+}
+
+
+int diff_match_patch::match_main(const MatchIndex &index, const std::wstring &pattern,
+                                 int loc) const
+{
+  return match_main(index, MatchPattern(pattern), loc);
+}
+
+
+int diff_match_patch::match_main(const MatchIndex &index, const MatchPattern &compiled,
+                                 int loc) const
+{
+  const std::wstring &text = index.text();
+  const std::wstring &pattern = compiled.text();
+  const int gram = index.gramLength();
+  const int length = pattern.length();
+  loc = std::max((size_t)0, std::min((size_t)loc, text.length()));
+  if (gram == 0 || length < gram || text == pattern || text.empty()
+      || (loc + pattern.length() <= text.length()
+          && text.compare(loc, pattern.length(), pattern) == 0)) {
+    // Nothing for the index to do.
+    return match_main(text, compiled, loc);
+  }
+  if (!(Match_MaxBits == 0 || pattern.length() <= Match_MaxBits)) {
+    throw "Pattern too long for this application.";
+  }
+
+  double score_threshold = Match_Threshold;
+  int best_loc = -1;
+  // Read no further than match_myers would, so as to find what it finds.
+  const int limit = std::min(size_t(loc + match_bitapReach(0, loc, pattern,
+      score_threshold, length + text.length())) + length, text.length());
+  // Search around loc first, where the match usually is: what turns up
+  // there limits the errors a match may have anywhere else.
+  match_scan(text, compiled, loc,
+             {std::make_pair(std::max(0, loc - 2 * length), std::min(limit, loc + 3 * length))},
+             score_threshold, best_loc);
+  // The most errors a match may have and still score within the threshold.
+  auto allowed = [&]() {
+    int errors = 0;
+    while (errors < length
+        && match_bitapScore(errors + 1, loc, loc, pattern) <= score_threshold) {
+      errors++;
+    }
+    return errors;
+  };
+  const int reach = match_bitapReach(0, loc, pattern, score_threshold,
+                                     length + text.length());
+  const int low = std::max(0, loc - reach);
+  const int high = std::min(limit - 1, loc + reach);
+
+  // Of any errors + 1 of the pattern's substrings at multiples of the gram
+  // length, a match with no more errors than that has one unchanged, near
+  // where it is in the pattern.  Pick the rarest, and search only around
+  // where they occur, unless that is most of the window anyway.
+  const int pieces = length / gram;
+  auto filter = [&](int errors) {
+    std::vector<std::pair<size_t, int>> rarest;
+    for (int i = 0; i < pieces; i++) {
+      rarest.push_back(std::make_pair(index.count(&pattern[i * gram]), i * gram));
+    }
+    std::sort(rarest.begin(), rarest.end());
+    rarest.resize(errors + 1);
+    // Spread evenly, the pieces would cover this much of the window.
+    size_t occurrences = 0;
+    for (const auto &piece : rarest) {
+      occurrences += piece.first;
+    }
+    if (occurrences * (2 * errors + 1) > text.length()) {
+      return false;
+    }
+
+    std::vector<std::pair<int, int>> spans;
+    std::vector<int> found;
+    for (const auto &piece : rarest) {
+      const int offset = piece.second;
+      found.clear();
+      index.find(&pattern[offset], low + offset - errors, high + offset + errors, found);
+      for (int pos : found) {
+        spans.push_back(std::make_pair(std::max(low, pos - offset - errors),
+                                       std::min(high, pos - offset + errors)));
+      }
+    }
+    std::sort(spans.begin(), spans.end());
+    // A match starting in a span may run on with up to 'errors' insertions.
+    // Join spans close enough that searching each would read the same text.
+    const int overhang = length + errors;
+    std::vector<std::pair<int, int>> joined;
+    for (const auto &span : spans) {
+      if (!joined.empty() && span.first <= joined.back().second + overhang) {
+        joined.back().second = std::max(joined.back().second, span.second);
+      } else {
+        joined.push_back(span);
+      }
+    }
+    long covered = 0;
+    for (auto &span : joined) {
+      covered += span.second - span.first + 1 + overhang;
+      span.second = std::min(limit, span.second + 1 + overhang);
+    }
+    if (2 * covered > high - low + 1 + overhang) {
+      return false;
+    }
+    match_scan(text, compiled, loc, joined, score_threshold, best_loc);
+    return true;
+  };
+
+  // With more errors allowed than there are pieces, look for a match with
+  // fewer first.  If it lowers the threshold enough, nothing with more
+  // errors can beat it; otherwise search everything.
+  if (!filter(std::min(allowed(), pieces - 1)) || allowed() >= pieces) {
+    match_scan(text, compiled, loc,
+               {std::make_pair(low, std::min(limit, high + 1 + length + allowed()))},
+               score_threshold, best_loc);
+  }
+  return best_loc;
+}
+
+
+std::vector<int> diff_match_patch::match_many(const std::wstring &text,
+    const std::vector<std::wstring> &patterns, const std::vector<int> &locs) const {
+  if (patterns.size() != locs.size()) {
+    throw "Patterns and locations differ in number.";
+  }
+  // Shortest piece worth looking for.
+  const int min_piece = 4;
+  const int text_length = text.length();
+  std::vector<int> results(patterns.size(), -1);
+
+  // Where each pattern may match, and the spans its pieces point at.
+  struct Search {
+    int loc;
+    int limit;
+    int low;
+    int high;
+    int errors;
+    double score_threshold;
+    int best_loc;
+    bool fuzzy;
+    bool filtered;
+    std::vector<std::pair<int, int>> spans;
+  };
+  std::vector<Search> searches(patterns.size());
+  std::vector<MatchPattern> compiled_patterns;
+  compiled_patterns.reserve(patterns.size());
+  for (const std::wstring &pattern : patterns) {
+    compiled_patterns.emplace_back(pattern);
+  }
+  // A piece of a pattern, ending at a node of the trie below.
+  struct Piece {
+    int pattern;
+    int offset;
+    int length;
+  };
+  std::vector<Piece> pieces;
+  // Aho-Corasick trie of the pieces: each node's edges, longest proper
+  // suffix in the trie, nearest such suffix ending pieces, and the pieces
+  // ending there.
+  struct Node {
+    int fail;
+    int output;
+    std::vector<std::pair<wchar_t, int>> children;
+    std::vector<int> ends;
+  };
+  std::vector<Node> nodes(1, Node{0, -1, {}, {}});
+  std::unordered_map<uint64_t, int> edges;
+  auto edge = [](int node, wchar_t c) {
+    return (static_cast<uint64_t>(node) << 32) | static_cast<uint32_t>(c);
+  };
+
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const std::wstring &pattern = patterns[i];
+    const int length = pattern.length();
+    const int loc = std::max((size_t)0, std::min((size_t)locs[i], text.length()));
+    Search &search = searches[i];
+    search.loc = loc;
+    search.fuzzy = false;
+    search.filtered = false;
+    if (text == pattern || text.empty() || (loc + pattern.length() <= text.length()
+        && text.compare(loc, pattern.length(), pattern) == 0)) {
+      continue;
+    }
+    if (!(Match_MaxBits == 0 || pattern.length() <= Match_MaxBits)) {
+      throw "Pattern too long for this application.";
+    }
+    // As match_main with an index: look around loc first, then bound the
+    // errors allowed anywhere else.  Of any errors + 1 pieces of the
+    // pattern, a match with no more errors has one unchanged.  If that would
+    // take pieces too short to be telling, filter for fewer errors, and fall
+    // back on searching the whole window unless that turns up something good
+    // enough.
+    const MatchPattern &compiled = compiled_patterns[i];
+    search.score_threshold = Match_Threshold;
+    search.best_loc = -1;
+    search.limit = std::min(size_t(loc + match_bitapReach(0, loc, pattern,
+        search.score_threshold, length + text.length())) + length, text.length());
+    match_scan(text, compiled, loc,
+               {std::make_pair(std::max(0, loc - 2 * length),
+                               std::min(search.limit, loc + 3 * length))},
+               search.score_threshold, search.best_loc);
+    int errors = 0;
+    while (errors < length
+        && match_bitapScore(errors + 1, loc, loc, pattern) <= search.score_threshold) {
+      errors++;
+    }
+    search.errors = std::min(errors, length / min_piece - 1);
+    const int reach = match_bitapReach(0, loc, pattern, search.score_threshold,
+                                       length + text.length());
+    search.low = std::max(0, loc - reach);
+    search.high = std::min(search.limit - 1, loc + reach);
+    search.fuzzy = true;
+    search.filtered = search.errors >= 0;
+    if (!search.filtered) {
+      continue;
+    }
+
+    const int piece_length = length / (search.errors + 1);
+    for (int offset = 0; offset + piece_length <= length; offset += piece_length) {
+      int node = 0;
+      for (int k = offset; k < offset + piece_length; k++) {
+        auto found = edges.find(edge(node, pattern[k]));
+        if (found == edges.end()) {
+          nodes.push_back(Node{0, -1, {}, {}});
+          nodes[node].children.push_back(std::make_pair(pattern[k], nodes.size() - 1));
+          found = edges.emplace(edge(node, pattern[k]), nodes.size() - 1).first;
+        }
+        node = found->second;
+      }
+      nodes[node].ends.push_back(pieces.size());
+      pieces.push_back(Piece{static_cast<int>(i), offset, piece_length});
+    }
+  }
+
+  // Link each node to its longest proper suffix in the trie, breadth first.
+  std::vector<int> queue;
+  for (const auto &child : nodes[0].children) {
+    queue.push_back(child.second);
+  }
+  for (size_t head = 0; head < queue.size(); head++) {
+    const int node = queue[head];
+    for (const auto &child : nodes[node].children) {
+      int fail = nodes[node].fail;
+      auto found = edges.find(edge(fail, child.first));
+      while (fail != 0 && found == edges.end()) {
+        fail = nodes[fail].fail;
+        found = edges.find(edge(fail, child.first));
+      }
+      const int suffix = found == edges.end() ? 0 : found->second;
+      nodes[child.second].fail = suffix;
+      nodes[child.second].output = nodes[suffix].ends.empty()
+          ? nodes[suffix].output : suffix;
+      queue.push_back(child.second);
+    }
+  }
+
+  // One pass over the text for all the pieces.  A pattern whose pieces turn
+  // up so often that its spans would cover most of its window is searched
+  // for in full instead.
+  int filtering = 0;
+  for (const Search &search : searches) {
+    filtering += search.filtered;
+  }
+  if (!pieces.empty()) {
+    int node = 0;
+    for (int j = 0; j < text_length && filtering > 0; j++) {
+      auto found = edges.find(edge(node, text[j]));
+      while (node != 0 && found == edges.end()) {
+        node = nodes[node].fail;
+        found = edges.find(edge(node, text[j]));
+      }
+      node = found == edges.end() ? 0 : found->second;
+      for (int out = nodes[node].ends.empty() ? nodes[node].output : node; out != -1;
+           out = nodes[out].output) {
+        for (int p : nodes[out].ends) {
+          const Piece &piece = pieces[p];
+          Search &search = searches[piece.pattern];
+          const int start = j - piece.length + 1 - piece.offset;
+          if (!search.filtered || start + search.errors < search.low
+              || start - search.errors > search.high) {
+            continue;
+          }
+          search.spans.push_back(std::make_pair(std::max(search.low, start - search.errors),
+              std::min(search.high, start + search.errors)));
+          if (2 * static_cast<long>(search.spans.size()) * (2 * search.errors + 1)
+              > search.high - search.low + 1) {
+            search.filtered = false;
+            search.spans.clear();
+            filtering--;
+          }
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const std::wstring &pattern = patterns[i];
+    Search &search = searches[i];
+    const MatchPattern &compiled = compiled_patterns[i];
+    if (!search.fuzzy) {
+      results[i] = match_main(text, compiled, search.loc);
+      continue;
+    }
+    // The most errors a match may have and still score within the threshold.
+    auto allowed = [&]() {
+      int errors = 0;
+      while (errors < static_cast<int>(pattern.length())
+          && match_bitapScore(errors + 1, search.loc, search.loc, pattern)
+              <= search.score_threshold) {
+        errors++;
+      }
+      return errors;
+    };
+    // The whole window, as far as a match with the errors allowed can run.
+    auto window = [&]() {
+      return std::vector<std::pair<int, int>>{std::make_pair(search.low,
+          std::min<int>(search.limit, search.high + 1 + pattern.length() + allowed()))};
+    };
+    if (!search.filtered) {
+      match_scan(text, compiled, search.loc, window(), search.score_threshold, search.best_loc);
+      results[i] = search.best_loc;
+      continue;
+    }
+    // Spans overlap each other wherever pieces do, so join them.
+    const int overhang = pattern.length() + search.errors;
+    std::sort(search.spans.begin(), search.spans.end());
+    std::vector<std::pair<int, int>> joined;
+    for (const auto &span : search.spans) {
+      if (!joined.empty() && span.first <= joined.back().second + overhang) {
+        joined.back().second = std::max(joined.back().second, span.second);
+      } else {
+        joined.push_back(span);
+      }
+    }
+    for (auto &span : joined) {
+      span.second = std::min(search.limit, span.second + 1 + overhang);
+    }
+    match_scan(text, compiled, search.loc, joined, search.score_threshold, search.best_loc);
+    if (allowed() > search.errors) {
+      // A match with more errors than filtered for could still win.
+      match_scan(text, compiled, search.loc, window(), search.score_threshold, search.best_loc);
+    }
+    results[i] = search.best_loc;
+  }
+  return results;
+}
+
+
+std::vector<MatchCandidate> diff_match_patch::match_candidates(const std::wstring &text,
+    const std::wstring &pattern, int loc, int k) const {
+  loc = std::max((size_t)0, std::min((size_t)loc, text.length()));
+  std::vector<MatchCandidate> best;
+  if (k <= 0 || text.empty()) {
+    return best;
+  }
+  if (pattern.empty()) {
+    // Matches anywhere, so best where expected, and perfectly.
+    best.push_back(MatchCandidate{loc, 0.0, 0});
+    return best;
+  }
+  if (!(Match_MaxBits == 0 || pattern.length() <= Match_MaxBits)) {
+    throw "Pattern too long for this application.";
+  }
+
+  // Every location within the threshold, with the fewest errors it takes.
+  const MatchPattern compiled(pattern);
+  double score_threshold = Match_Threshold;
+  int best_loc = -1;
+  const int reach = match_bitapReach(0, loc, pattern, score_threshold,
+                                     pattern.length() + text.length());
+  std::vector<MatchCandidate> found;
+  match_myersScan(text, compiled, loc, std::max(0, loc - reach),
+                  std::min(size_t(loc + reach) + pattern.length(), text.length()),
+                  score_threshold, best_loc, &found);
+
+  // Next to a match, there are worse ones a few characters either way.  Keep
+  // only the best of those which overlap.
+  std::sort(found.begin(), found.end(),
+            [](const MatchCandidate &a, const MatchCandidate &b) {
+    return std::tie(a.score, a.errors, a.location) < std::tie(b.score, b.errors, b.location);
+  });
+  const int length = pattern.length();
+  for (const MatchCandidate &candidate : found) {
+    bool overlaps = false;
+    for (const MatchCandidate &kept : best) {
+      overlaps = overlaps || std::abs(kept.location - candidate.location) < length;
+    }
+    if (!overlaps) {
+      best.push_back(candidate);
+      if (static_cast<int>(best.size()) == k) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+
+// Set the lowest 'level' bits of a Bitap state: past the end of what is
+// read, that many of the pattern's characters can still be left out.
+static void bitapEdge(uint64_t *edge, int level, int words)
+{
+  for (int w = 0; w < words; w++) {
+    const int bits = std::min(std::max(level - 64 * w, 0), 64);
+    edge[w] = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+  }
+}
+
+
+// Work out a Bitap state from the one after it on the same level and, past
+// the first level, the states at and after it on the level before.
+static void bitapStep(uint64_t *row, const uint64_t *next, const uint64_t *last,
+                      const uint64_t *last_next, const uint64_t *charMatch, int words)
+{
+  // The shifts carry from word to word.
+  uint64_t carry = 1;
+  uint64_t last_carry = 1;
+  for (int w = 0; w < words; w++) {
+    const uint64_t shifted = (next[w] << 1) | carry;
+    carry = next[w] >> 63;
+    if (last == nullptr) {
+      // First pass: exact match.
+      row[w] = shifted & charMatch[w];
+    } else {
+      // Subsequent passes: fuzzy match.
+      const uint64_t either = last_next[w] | last[w];
+      row[w] = (shifted & charMatch[w])
+          | ((either << 1) | last_carry)
+          | last_next[w];
+      last_carry = either >> 63;
+    }
+  }
+}
+
+
+int diff_match_patch::match_bitap(const std::wstring &text, const std::wstring &pattern,
+                                  int loc) const {
+  return match_bitap(text, MatchPattern(pattern), loc);
+}
+
+
+int diff_match_patch::match_bitap(const std::wstring &text, const MatchPattern &compiled,
+                                  int loc) const {
+  const std::wstring &pattern = compiled.text();
+  if (!(Match_MaxBits == 0 || pattern.length() <= Match_MaxBits)) {
+    throw "Pattern too long for this application.";
+  }
+
+  // The alphabet, compiled already.
+  const MatchAlphabet &s = compiled.alphabet();
+
+  // Highest score beyond which we give up.
+  double score_threshold = match_exactThreshold(text, pattern, loc);
+
+  // Initialise the bit arrays.  Each state is a vector of 64-bit words,
+  // least significant first, as long as the pattern needs.
+  const int words = s.words();
+  const int matchword = (pattern.length() - 1) / 64;
+  const uint64_t matchmask = uint64_t(1) << ((pattern.length() - 1) % 64);
+  const std::vector<uint64_t> nomatch(words);
+  int best_loc = -1;
+
+  // Error levels are worked through a group at a time.  A single pass over
+  // the window advances every level of the group, sharing the alphabet
+  // lookups, and notes where each level matches.  The matches are then
+  // judged level by level, as a pass per level would.  A match which lowers
+  // the threshold narrows the windows of the levels after it, so the rest of
+  // the group is redone.
+  const int group_size = 8;
+  int bin_max = pattern.length() + text.length();
+  // The windows only shrink, so the first level's holds them all.  Rows
+  // cover just that window, from 'base' to one past its end.
+  const int widest = match_bitapReach(0, loc, pattern, score_threshold, bin_max);
+  const int base = std::max(1, loc - widest + 1);
+  const size_t row_length = (std::min(size_t(loc + widest), text.length())
+      + pattern.length() + 2 - base) * words;
+  // One row per level of the group and one for the level before it, in a
+  // per-thread buffer which is reused from group to group and call to call,
+  // unless this call left it oversized.  Wide windows get smaller groups, so
+  // that the buffer stays within the scratch limit where it can, and at two
+  // rows where it cannot.
+  const int group = std::max(1, std::min(group_size,
+      static_cast<int>(scratchKeepBytes / (row_length * sizeof(uint64_t))) - 1));
+  static thread_local std::vector<uint64_t> rows;
+  static thread_local std::vector<int> hits[group_size];
+  const ScratchTrim<uint64_t> trim_rows(rows);
+  const ScratchTrim<int> trim_hits(hits, group_size);
+  if (rows.size() < (group + 1) * row_length) {
+    rows.resize((group + 1) * row_length);
+  }
+  uint64_t *rd[group_size + 1];
+  for (int g = 0; g <= group; g++) {
+    rd[g] = rows.data() + g * row_length;
+  }
+
+  int d = 0;
+  while (d < pattern.length()) {
+    // Work out how far from 'loc' each level can stray, as long as none
+    // finds a better match.
+    int reach[group_size];
+    int start[group_size];
+    int finish[group_size];
+    int levels = 0;
+    for (int reach_max = bin_max; levels < group && d + levels < pattern.length();
+         levels++) {
+      const int level = d + levels;
+      if (levels > 0 && match_bitapScore(level, loc, loc, compiled) > score_threshold) {
+        break;
+      }
+      reach[levels] = match_bitapReach(level, loc, pattern, score_threshold, reach_max);
+      reach_max = reach[levels];
+      start[levels] = std::max(1, loc - reach[levels] + 1);
+      finish[levels] = std::min(size_t(loc + reach[levels]), text.length())
+          + pattern.length();
+      bitapEdge(rd[levels + 1] + (finish[levels] + 1 - base) * words, level, words);
+      hits[levels].clear();
+    }
+
+    // Advance one level of the group over its whole window, the slow way.
+    auto advance = [&](int g, bool record) {
+      const bool exact = d + g == 0;
+      for (int j = finish[g]; j >= start[g]; j--) {
+        const uint64_t *charMatch = nomatch.data();
+        if (text.length() > j - 1) {
+          charMatch = s[text[j - 1]];
+        }
+        uint64_t *row = rd[g + 1] + (j - base) * words;
+        const uint64_t *last = rd[g] + (j - base) * words;
+        bitapStep(row, row + words, exact ? nullptr : last, last + words, charMatch, words);
+        if (record && (row[matchword] & matchmask) != 0) {
+          hits[g].push_back(j);
+        }
+      }
+    };
+
+    if (words == 1) {
+      // All levels in one pass.  Each level's state at j + 1 is kept in a
+      // register, starting out as its edge, which is also what the next
+      // level reads there.  The windows nest, so the levels live at a
+      // position are a prefix of the group.  Only the last level's row is
+      // stored; the others are only needed if the group is cut short.
+      uint64_t state[group_size];
+      for (int g = 0; g < levels; g++) {
+        state[g] = rd[g + 1][finish[g] + 1 - base];
+      }
+      const uint64_t *before = rd[0];
+      uint64_t *after = rd[levels];
+      for (int j = finish[0]; j >= start[0]; j--) {
+        const uint64_t charMatch = text.length() > j - 1 ? s[text[j - 1]][0] : 0;
+        // The level before's state at j and at j + 1.
+        uint64_t last = before[j - base];
+        uint64_t last_next = before[j + 1 - base];
+        int g = 0;
+        for (; g < levels && j <= finish[g] && j >= start[g]; g++) {
+          uint64_t row;
+          if (d + g == 0) {
+            row = ((state[g] << 1) | 1) & charMatch;
+          } else {
+            row = ((state[g] << 1) | 1) & charMatch
+                | (((last_next | last) << 1) | 1)
+                | last_next;
+          }
+          last_next = state[g];
+          last = row;
+          state[g] = row;
+          if ((row & matchmask) != 0) {
+            hits[g].push_back(j);
+          }
+        }
+        if (g == levels) {
+          after[j - base] = last;
+        }
+      }
+    } else {
+      for (int g = 0; g < levels; g++) {
+        advance(g, true);
+      }
+    }
+
+    int done = levels;
+    for (int g = 0; g < levels; g++) {
+      const int level = d + g;
+      bool improved = false;
+      int level_start = start[g];
+      for (int j : hits[g]) {
+        if (j < level_start) {
+          break;
+        }
+        double score = match_bitapScore(level, j - 1, loc, compiled);
+        // This match will almost certainly be better than any existing
+        // match.  But check anyway.
+        if (score <= score_threshold) {
+          // Told you so.
+          score_threshold = score;
+          best_loc = j - 1;
+          improved = true;
+          if (best_loc > loc) {
+            // When passing loc, don't exceed our current distance from loc.
+            level_start = std::max(1, 2 * loc - best_loc);
+          } else {
+            // Already passed loc, downhill from here on in.
+            break;
+          }
+        }
+      }
+      // Use the result from this level as the maximum for the next.
+      bin_max = reach[g];
+      if (match_bitapScore(level + 1, loc, loc, compiled) > score_threshold) {
+        // No hope for a (better) match at greater error levels.
+        return best_loc;
+      }
+      if (improved) {
+        done = g + 1;
+        if (words == 1 && done < levels) {
+          // Fill in the rows the single pass skipped.
+          for (int r = 0; r < done; r++) {
+            advance(r, false);
+          }
+        }
+        break;
+      }
+    }
+    // The last level judged is the one before the next group.
+    std::swap(rd[0], rd[done]);
+    d += done;
+  }
+  return best_loc;
+}
+
+
+int diff_match_patch::match_myers(const std::wstring &text, const std::wstring &pattern,
+                                  int loc) const {
+  return match_myers(text, MatchPattern(pattern), loc);
+}
+
+
+int diff_match_patch::match_myers(const std::wstring &text, const MatchPattern &compiled,
+                                  int loc) const {
+  const std::wstring &pattern = compiled.text();
+  if (!(Match_MaxBits == 0 || pattern.length() <= Match_MaxBits)) {
+    throw "Pattern too long for this application.";
+  }
+
+  // Highest score beyond which we give up.
+  double score_threshold = match_exactThreshold(text, pattern, loc);
+  int best_loc = -1;
+  // How far from 'loc' even an exact match may be.  A match may run on past
+  // that, so start reading a pattern's length further on.
+  const int reach = match_bitapReach(0, loc, pattern, score_threshold,
+                                     pattern.length() + text.length());
+  match_myersScan(text, compiled, loc, std::max(0, loc - reach),
+                  std::min(size_t(loc + reach) + pattern.length(), text.length()),
+                  score_threshold, best_loc);
+  return best_loc;
+}
+
+
+void diff_match_patch::match_myersScan(const std::wstring &text, const MatchPattern &pattern,
+                                       int loc, int first, int end,
+                                       double &score_threshold, int &best_loc,
+                                       std::vector<MatchCandidate> *candidates) const {
+  // The alphabet's masks have the pattern backwards, so the text is read
+  // backwards too: the last row then holds the fewest errors of a match
+  // starting at each location.
+  const MatchAlphabet &s = pattern.alphabet();
+  const int words = s.words();
+  const uint64_t last = uint64_t(1) << ((pattern.text().length() - 1) % 64);
+  static thread_local std::vector<uint64_t> vectors;
+  const ScratchTrim<uint64_t> trim(vectors);
+  if (vectors.size() < 2 * static_cast<size_t>(words)) {
+    vectors.resize(2 * words);
+  }
+  uint64_t *plus = vectors.data();
+  uint64_t *minus = plus + words;
+  std::fill(plus, plus + words, ~uint64_t(0));
+  std::fill(minus, minus + words, 0);
+  int errors = pattern.text().length();
+  for (int x = end - 1; x >= first; x--) {
+    // A match may start anywhere, so row 0 stays at zero.
+    errors += myersColumn(s[text[x]], plus, minus, words, last, 0);
+    const double score = match_bitapScore(errors, x, loc, pattern);
+    if (score <= score_threshold) {
+      if (candidates != nullptr) {
+        candidates->push_back(MatchCandidate{x, score, errors});
+      } else {
+        score_threshold = score;
+        best_loc = x;
+      }
+    }
+    if (x <= loc && match_bitapScore(0, x - 1, loc, pattern) > score_threshold) {
+      // Downhill from here on in.
+      break;
+    }
+  }
+}
+
+
+void diff_match_patch::match_bitapScan(const std::wstring &text, const MatchPattern &pattern,
+                                       int loc, const std::vector<std::pair<int, int>> &spans,
+                                       double &score_threshold, int &best_loc) const {
+  const MatchAlphabet &s = pattern.alphabet();
+  const int length = pattern.text().length();
+  const int words = s.words();
+  const int matchword = (length - 1) / 64;
+  const uint64_t matchmask = uint64_t(1) << ((length - 1) % 64);
+  const std::vector<uint64_t> nomatch(words);
+
+  // Each span has a row per level, as match_bitap's window does, from one
+  // past its first location to one past its end.  The level before's rows
+  // are kept alongside.
+  size_t total = 0;
+  for (const auto &span : spans) {
+    total += (span.second - span.first + 2) * words;
+  }
+  static thread_local std::vector<uint64_t> rows;
+  const ScratchTrim<uint64_t> trim(rows);
+  rows.assign(2 * total, 0);
+  uint64_t *rd = rows.data();
+  uint64_t *last_rd = rd + total;
+
+  int bin_max = length + text.length();
+  for (int d = 0; d < length; d++) {
+    if (match_bitapScore(d, loc, loc, pattern) > score_threshold) {
+      // No hope for a (better) match at greater error levels.
+      break;
+    }
+    // Only what match_bitap's window for this level holds is looked at.
+    const int reach = match_bitapReach(d, loc, pattern.text(), score_threshold, bin_max);
+    bin_max = reach;
+    int start = std::max(1, loc - reach + 1);
+    const int finish = std::min(size_t(loc + reach), text.length()) + length;
+    bool passed = false;
+    size_t offset = total;
+    for (auto span = spans.rbegin(); span != spans.rend() && !passed; ++span) {
+      offset -= (span->second - span->first + 2) * words;
+      const int base = span->first + 1;
+      const int top = std::min(span->second, finish);
+      if (top < base) {
+        continue;
+      }
+      uint64_t *row = rd + offset;
+      const uint64_t *last = last_rd + offset;
+      bitapEdge(row + (top + 1 - base) * words, d, words);
+      for (int j = top; j >= std::max(base, start); j--) {
+        const uint64_t *charMatch = text.length() > j - 1 ? s[text[j - 1]] : nomatch.data();
+        const size_t at = (j - base) * words;
+        bitapStep(row + at, row + at + words, d == 0 ? nullptr : last + at,
+                  last + at + words, charMatch, words);
+        if ((row[at + matchword] & matchmask) != 0) {
+          const double score = match_bitapScore(d, j - 1, loc, pattern);
+          if (score <= score_threshold) {
+            score_threshold = score;
+            best_loc = j - 1;
+            if (best_loc > loc) {
+              // When passing loc, don't exceed our current distance from loc.
+              start = std::max(1, 2 * loc - best_loc);
+            } else {
+              // Already passed loc, downhill from here on in.
+              passed = true;
+              break;
+            }
+          }
+        }
+      }
+    }
+    std::swap(rd, last_rd);
+  }
 }
 
 
-  //  MATCH FUNCTIONS
-
-
-int diff_match_patch::match_main(const std::wstring &text, const std::wstring &pattern,
-                                 int loc)
-{
-  loc = std::max((size_t)0, std::min((size_t)loc, text.length()));
-  if (text == pattern) {
-    // Shortcut (potentially not guaranteed by the algorithm)
-    return 0;
-  } else if (text.empty()) {
-    // Nothing to match.
-    return -1;
-  } else if (loc + pattern.length() <= text.length()
-      && text.substr(loc, pattern.length()) == pattern) {
-    // Perfect match at the perfect spot!  (Includes case of null pattern)
-    return loc;
+void diff_match_patch::match_scan(const std::wstring &text, const MatchPattern &pattern,
+                                  int loc, const std::vector<std::pair<int, int>> &spans,
+                                  double &score_threshold, int &best_loc) const {
+  if (Match_Algorithm == MatchAlgorithm::Myers) {
+    // From the end back, as match_myers would.
+    for (auto it = spans.rbegin(); it != spans.rend(); ++it) {
+      match_myersScan(text, pattern, loc, it->first, it->second, score_threshold, best_loc);
+    }
   } else {
-    // Do a fuzzy compare.
-    return match_bitap(text, pattern, loc);
+    match_bitapScan(text, pattern, loc, spans, score_threshold, best_loc);
   }
 }
 
 
-int diff_match_patch::match_bitap(const std::wstring &text, const std::wstring &pattern,
-                                  int loc) {
-  if (!(Match_MaxBits == 0 || pattern.length() <= Match_MaxBits)) {
-    throw "Pattern too long for this application.";
-  }
-
-  // Initialise the alphabet.
-  std::map<wchar_t, int> s = match_alphabet(pattern);
-
-  // Highest score beyond which we give up.
+double diff_match_patch::match_exactThreshold(const std::wstring &text,
+                                              const std::wstring &pattern,
+                                              int loc) const {
   double score_threshold = Match_Threshold;
   // Is there a nearby exact match? (speedup)
   int best_loc = text.find(pattern, loc);
@@ -1516,85 +4312,37 @@ int diff_match_patch::match_bitap(const std::wstring &text, const std::wstring &
           score_threshold);
     }
   }
+  return score_threshold;
+}
 
-  // Initialise the bit arrays.
-  int matchmask = 1 << (pattern.length() - 1);
-  best_loc = -1;
-
-  int bin_min, bin_mid;
-  int bin_max = pattern.length() + text.length();
-  int *rd;
-  int *last_rd = NULL;
-  for (int d = 0; d < pattern.length(); d++) {
-    // Scan for the best match; each iteration allows for one more error.
-    // Run a binary search to determine how far from 'loc' we can stray at
-    // this error level.
-    bin_min = 0;
-    bin_mid = bin_max;
-    while (bin_min < bin_mid) {
-      if (match_bitapScore(d, loc + bin_mid, loc, pattern)
-          <= score_threshold) {
-        bin_min = bin_mid;
-      } else {
-        bin_max = bin_mid;
-      }
-      bin_mid = (bin_max - bin_min) / 2 + bin_min;
-    }
-    // Use the result from this iteration as the maximum for the next.
-    bin_max = bin_mid;
-    int start = std::max(1, loc - bin_mid + 1);
-    int finish = std::min(size_t(loc + bin_mid), text.length()) + pattern.length();
 
-    rd = new int[finish + 2];
-    rd[finish + 1] = (1 << d) - 1;
-    for (int j = finish; j >= start; j--) {
-      int charMatch = 0;
-      if (text.length() > j - 1) {
-        if (s.find(text[j - 1]) != s.end())
-          charMatch = s[text[j - 1]];
-      }
-      if (d == 0) {
-        // First pass: exact match.
-        rd[j] = ((rd[j + 1] << 1) | 1) & charMatch;
-      } else {
-        // Subsequent passes: fuzzy match.
-        rd[j] = ((rd[j + 1] << 1) | 1) & charMatch
-            | (((last_rd[j + 1] | last_rd[j]) << 1) | 1)
-            | last_rd[j + 1];
-      }
-      if ((rd[j] & matchmask) != 0) {
-        double score = match_bitapScore(d, j - 1, loc, pattern);
-        // This match will almost certainly be better than any existing
-        // match.  But check anyway.
-        if (score <= score_threshold) {
-          // Told you so.
-          score_threshold = score;
-          best_loc = j - 1;
-          if (best_loc > loc) {
-            // When passing loc, don't exceed our current distance from loc.
-            start = std::max(1, 2 * loc - best_loc);
-          } else {
-            // Already passed loc, downhill from here on in.
-            break;
-          }
-        }
-      }
-    }
-    if (match_bitapScore(d + 1, loc, loc, pattern) > score_threshold) {
-      // No hope for a (better) match at greater error levels.
-      break;
-    }
-    delete [] last_rd;
-    last_rd = rd;
+int diff_match_patch::match_bitapReach(int d, int loc, const std::wstring &pattern,
+                                       double score_threshold, int bin_max) const {
+  if (match_bitapScore(d, loc + bin_max, loc, pattern) <= score_threshold) {
+    return bin_max;
   }
-  delete [] last_rd;
-  delete [] rd;
-  return best_loc;
+  // The score grows by 1 / Match_Distance per character of distance, so
+  // solve for the distance and then settle any rounding against the score
+  // itself, to land where a binary search over it would.
+  int reach = 0;
+  if (Match_Distance != 0) {
+    const double estimate = (score_threshold - static_cast<double>(d) / pattern.length())
+        * Match_Distance;
+    reach = static_cast<int>(std::max(0.0, std::min<double>(bin_max - 1, std::floor(estimate))));
+  }
+  while (reach + 1 < bin_max
+      && match_bitapScore(d, loc + reach + 1, loc, pattern) <= score_threshold) {
+    reach++;
+  }
+  while (reach > 0 && match_bitapScore(d, loc + reach, loc, pattern) > score_threshold) {
+    reach--;
+  }
+  return reach;
 }
 
 
 double diff_match_patch::match_bitapScore(int e, int x, int loc,
-                                          const std::wstring &pattern) {
+                                          const std::wstring &pattern) const {
   const float accuracy = static_cast<float> (e) / pattern.length();
   const int proximity = std::abs(loc - x);
   if (Match_Distance == 0) {
@@ -1605,7 +4353,20 @@ double diff_match_patch::match_bitapScore(int e, int x, int loc,
 }
 
 
-std::map<wchar_t, int> diff_match_patch::match_alphabet(const std::wstring &pattern) {
+double diff_match_patch::match_bitapScore(int e, int x, int loc,
+                                          const MatchPattern &pattern) const {
+  // The same as above, with the accuracy looked up.
+  const float accuracy = pattern.accuracy(e);
+  const int proximity = std::abs(loc - x);
+  if (Match_Distance == 0) {
+    // Dodge divide by zero error.
+    return proximity == 0 ? accuracy : 1.0;
+  }
+  return accuracy + (proximity / static_cast<float> (Match_Distance));
+}
+
+
+std::map<wchar_t, int> diff_match_patch::match_alphabet(const std::wstring &pattern) const {
   std::map<wchar_t, int> s;
   int i;
   for (i = 0; i < pattern.length(); i++) {
@@ -1623,7 +4384,7 @@ std::map<wchar_t, int> diff_match_patch::match_alphabet(const std::wstring &patt
 //  PATCH FUNCTIONS
 
 
-void diff_match_patch::patch_addContext(Patch &patch, const std::wstring &text) {
+void diff_match_patch::patch_addContext(Patch &patch, const std::wstring &text) const {
   if (text.empty()) {
     return;
   }
@@ -1666,7 +4427,7 @@ void diff_match_patch::patch_addContext(Patch &patch, const std::wstring &text)
 
 
 std::deque<Patch> diff_match_patch::patch_make(const std::wstring &text1,
-                                          const std::wstring &text2)
+                                          const std::wstring &text2) const
 {
   // No diffs provided, compute our own.
   std::deque<Diff> diffs = diff_main(text1, text2, true);
@@ -1679,7 +4440,7 @@ std::deque<Patch> diff_match_patch::patch_make(const std::wstring &text1,
 }
 
 
-std::deque<Patch> diff_match_patch::patch_make(const std::deque<Diff> &diffs) {
+std::deque<Patch> diff_match_patch::patch_make(const std::deque<Diff> &diffs) const {
   // No origin string provided, compute our own.
   const std::wstring text1 = diff_text1(diffs);
   return patch_make(text1, diffs);
@@ -1688,7 +4449,7 @@ std::deque<Patch> diff_match_patch::patch_make(const std::deque<Diff> &diffs) {
 
 std::deque<Patch> diff_match_patch::patch_make(const std::wstring &text1,
                                           const std::wstring &text2,
-                                          const std::deque<Diff> &diffs) {
+                                          const std::deque<Diff> &diffs) const {
   // text2 is entirely unused.
   (void)text2;
   return patch_make(text1, diffs);
@@ -1696,7 +4457,7 @@ std::deque<Patch> diff_match_patch::patch_make(const std::wstring &text1,
 
 
 std::deque<Patch> diff_match_patch::patch_make(const std::wstring &text1,
-                                          const std::deque<Diff> &diffs)
+                                          const std::deque<Diff> &diffs) const
 {
   std::deque<Patch> patches;
   if (diffs.empty()) {
@@ -1773,7 +4534,18 @@ std::deque<Patch> diff_match_patch::patch_make(const std::wstring &text1,
 }
 
 
-std::deque<Patch> diff_match_patch::patch_deepCopy(std::deque<Patch> &patches) {
+std::vector<std::deque<Patch>> diff_match_patch::patch_batch(
+    const std::vector<std::pair<std::wstring, std::wstring>> &pairs,
+    int threads) const {
+  std::vector<std::deque<Patch>> results(pairs.size());
+  runBatch(batchCosts(pairs), threads, [&](size_t i) {
+    results[i] = patch_make(pairs[i].first, pairs[i].second);
+  });
+  return results;
+}
+
+
+std::deque<Patch> diff_match_patch::patch_deepCopy(const std::deque<Patch> &patches) const {
   std::deque<Patch> patchesCopy;
   for (const Patch& aPatch : patches) {
     Patch patchCopy = Patch();
@@ -1792,17 +4564,18 @@ std::deque<Patch> diff_match_patch::patch_deepCopy(std::deque<Patch> &patches) {
 
 
 std::pair<std::wstring, std::deque<bool>> diff_match_patch::patch_apply(
-    std::deque<Patch> &patches, const std::wstring &sourceText) {
-  std::wstring text = sourceText;  // Copy to preserve original.
+    const std::deque<Patch> &patches, const std::wstring &sourceText) const {
   if (patches.empty()) {
-    return std::make_pair(text, std::deque<bool>(0));
+    return std::make_pair(sourceText, std::deque<bool>(0));
   }
 
   // Deep copy the patches so that no changes are made to originals.
   std::deque<Patch> patchesCopy = patch_deepCopy(patches);
 
   std::wstring nullPadding = patch_addPadding(patchesCopy);
-  text = nullPadding + text + nullPadding;
+  // The text is edited in place, through the index.
+  MatchIndex index(nullPadding + sourceText + nullPadding, Patch_IndexGram);
+  const std::wstring &text = index.text();
   patch_splitMax(patchesCopy);
 
   int x = 0;
@@ -1820,9 +4593,9 @@ std::pair<std::wstring, std::deque<bool>> diff_match_patch::patch_apply(
     if (text1.length() > Match_MaxBits) {
       // patch_splitMax will only provide an oversized pattern in the case of
       // a monster delete.
-      start_loc = match_main(text, text1.substr(0, Match_MaxBits), expected_loc);
+      start_loc = match_main(index, text1.substr(0, Match_MaxBits), expected_loc);
       if (start_loc != -1) {
-        end_loc = match_main(text, text1.substr(text1.length() - Match_MaxBits),
+        end_loc = match_main(index, text1.substr(text1.length() - Match_MaxBits),
             expected_loc + text1.length() - Match_MaxBits);
         if (end_loc == -1 || start_loc >= end_loc) {
           // Can't find valid trailing context.  Drop this patch.
@@ -1830,7 +4603,7 @@ std::pair<std::wstring, std::deque<bool>> diff_match_patch::patch_apply(
         }
       }
     } else {
-      start_loc = match_main(text, text1, expected_loc);
+      start_loc = match_main(index, text1, expected_loc);
     }
     if (start_loc == -1) {
       // No match found.  :(
@@ -1849,15 +4622,23 @@ std::pair<std::wstring, std::deque<bool>> diff_match_patch::patch_apply(
       }
       if (text1 == text2) {
         // Perfect match, just shove the replacement text in.
-        text = text.substr(0, start_loc) + diff_text2(aPatch.diffs)
-            + text.substr(start_loc + text1.length());
+        index.replace(start_loc, text1.length(), diff_text2(aPatch.diffs));
       } else {
         // Imperfect match.  Run a diff to get a framework of equivalent
-        // indices.
-        std::deque<Diff> diffs = diff_main(text1, text2, false);
-        if (text1.length() > Match_MaxBits
+        // indices.  For monster deletes the diff is bounded: a diff's
+        // Levenshtein distance is at least half of what it inserts and
+        // deletes, so content more edits apart than that fails outright.
+        std::deque<Diff> diffs;
+        bool within = true;
+        if (text1.length() > Match_MaxBits) {
+          within = diff_bounded(text1, text2,
+              static_cast<int>(2 * Patch_DeleteThreshold * text1.length()), diffs);
+        } else {
+          diffs = diff_main(text1, text2, false);
+        }
+        if (!within || (text1.length() > Match_MaxBits
             && diff_levenshtein(diffs) / static_cast<float> (text1.length())
-            > Patch_DeleteThreshold) {
+            > Patch_DeleteThreshold)) {
           // The end points match, but the content is unacceptably bad.
           results[x] = false;
         } else {
@@ -1868,12 +4649,11 @@ std::pair<std::wstring, std::deque<bool>> diff_match_patch::patch_apply(
               int index2 = diff_xIndex(diffs, index1);
               if (aDiff.operation == Diff::Operation::Insert) {
                 // Insertion
-                text = text.substr(0, start_loc + index2) + aDiff.text
-                    + text.substr(start_loc + index2);
+                index.replace(start_loc + index2, 0, aDiff.text);
               } else if (aDiff.operation == Diff::Operation::Delete) {
                 // Deletion
-                text = text.substr(0, start_loc + index2)
-                    + text.substr(start_loc + diff_xIndex(diffs, index1 + aDiff.text.length()));
+                index.replace(start_loc + index2,
+                    diff_xIndex(diffs, index1 + aDiff.text.length()) - index2, L"");
               }
             }
             if (aDiff.operation != Diff::Operation::Delete) {
@@ -1886,12 +4666,12 @@ std::pair<std::wstring, std::deque<bool>> diff_match_patch::patch_apply(
     x++;
   }
   // Strip the padding off.
-  text = text.substr(nullPadding.length(), text.length() - 2 * nullPadding.length());
-  return std::make_pair(text, results);
+  return std::make_pair(text.substr(nullPadding.length(),
+      text.length() - 2 * nullPadding.length()), results);
 }
 
 
-std::wstring diff_match_patch::patch_addPadding(std::deque<Patch> &patches) {
+std::wstring diff_match_patch::patch_addPadding(std::deque<Patch> &patches) const {
   short paddingLength = Patch_Margin;
   std::wstring nullPadding = L"";
   for (short x = 1; x <= paddingLength; x++) {
@@ -1947,7 +4727,7 @@ std::wstring diff_match_patch::patch_addPadding(std::deque<Patch> &patches) {
 }
 
 
-void diff_match_patch::patch_splitMax(std::deque<Patch> &patches) {
+void diff_match_patch::patch_splitMax(std::deque<Patch> &patches) const {
   short patch_size = Match_MaxBits;
   std::wstring precontext, postcontext;
   Patch patch;
@@ -2050,7 +4830,7 @@ void diff_match_patch::patch_splitMax(std::deque<Patch> &patches) {
 }
 
 
-std::wstring diff_match_patch::patch_toText(const std::deque<Patch> &patches) {
+std::wstring diff_match_patch::patch_toText(const std::deque<Patch> &patches) const {
   std::wstring text;
   for (const Patch& aPatch : patches) {
     text.append(aPatch.toString());
@@ -2059,7 +4839,7 @@ std::wstring diff_match_patch::patch_toText(const std::deque<Patch> &patches) {
 }
 
 
-std::deque<Patch> diff_match_patch::patch_fromText(const std::wstring &textline) {
+std::deque<Patch> diff_match_patch::patch_fromText(const std::wstring &textline) const {
   std::deque<Patch> patches;
   if (textline.empty()) {
     return patches;
@@ -2140,3 +4920,560 @@ std::deque<Patch> diff_match_patch::patch_fromText(const std::wstring &textline)
   }
   return patches;
 }
+
+
+/////////////////////////////////////////////
+//
+// DiffHunks Class
+//
+/////////////////////////////////////////////
+
+
+DiffHunks::DiffHunks(const diff_match_patch &_dmp, std::wstring _text1,
+                     std::wstring _text2) :
+  dmp(_dmp), text1(std::move(_text1)), text2(std::move(_text2)), pulled1(0), pulled2(0),
+  pos1(0), pos2(0), open(false), insertions(0), deletions(0) {
+}
+
+
+int DiffHunks::size() {
+  while (split()) {
+  }
+  return hunks.size();
+}
+
+
+bool DiffHunks::has(int index) {
+  while (static_cast<int>(hunks.size()) <= index && split()) {
+  }
+  return index < static_cast<int>(hunks.size());
+}
+
+
+int DiffHunks::find(int loc) {
+  while ((hunks.empty() || hunks.back().start1 + hunks.back().length1 < loc)
+         && split()) {
+  }
+  // Hunks are sorted and disjoint, so bisect on their end points.
+  auto it = std::lower_bound(hunks.begin(), hunks.end(), loc,
+      [](const Patch &aHunk, int aLoc) {
+    return aHunk.start1 + aHunk.length1 < aLoc;
+  });
+  return it == hunks.end() ? -1 : it - hunks.begin();
+}
+
+
+const Patch &DiffHunks::hunk(int index) {
+  has(index);
+  Patch &aHunk = hunks[index];
+  if (!computed[index]) {
+    aHunk.diffs = dmp.diff_main(text1.substr(aHunk.start1, aHunk.length1),
+                                text2.substr(aHunk.start2, aHunk.length2));
+    computed[index] = true;
+  }
+  return aHunk;
+}
+
+
+bool DiffHunks::split() {
+  while (true) {
+    if (lineDiffs.empty() && !pull()) {
+      break;
+    }
+    const Diff::Operation op = lineDiffs.front().first;
+    if (op == Diff::Operation::Equal) {
+      // Equalities no larger than the edits on both sides of them are freak
+      // matches (e.g. blank lines); keep them inside the hunk.  Unless this
+      // one outgrows the edits before it, pull until it is whole and the
+      // edits after it are in, or the texts end.
+      bool freak = false;
+      size_t i = 1;
+      int after1 = 0;
+      int after2 = 0;
+      while (open && lineDiffs.front().second <= std::max(insertions, deletions)) {
+        if (i == lineDiffs.size()) {
+          if (!pull()) {
+            break;
+          }
+        } else if (lineDiffs[i].first != Diff::Operation::Equal) {
+          (lineDiffs[i].first == Diff::Operation::Insert ? after2 : after1) += lineDiffs[i].second;
+          i++;
+        } else {
+          break;
+        }
+      }
+      const int length = lineDiffs.front().second;
+      if (open && i > 1) {
+        freak = length <= std::max(insertions, deletions)
+            && length <= std::max(after1, after2);
+      }
+      insertions = 0;
+      deletions = 0;
+      pos1 += length;
+      pos2 += length;
+      lineDiffs.pop_front();
+      if (open && !freak) {
+        hunks.push_back(pending);
+        computed.push_back(false);
+        open = false;
+        return true;
+      }
+    } else {
+      if (!open) {
+        // A new hunk starts here.
+        pending = Patch();
+        pending.start1 = pos1;
+        pending.start2 = pos2;
+        open = true;
+      }
+      const int length = lineDiffs.front().second;
+      if (op == Diff::Operation::Insert) {
+        insertions += length;
+        pos2 += length;
+      } else {
+        deletions += length;
+        pos1 += length;
+      }
+      lineDiffs.pop_front();
+    }
+    if (open) {
+      pending.length1 = pos1 - pending.start1;
+      pending.length2 = pos2 - pending.start2;
+    }
+  }
+  if (open) {
+    hunks.push_back(pending);
+    computed.push_back(false);
+    open = false;
+    return true;
+  }
+  return false;
+}
+
+
+// Lines DiffHunks::pull takes in at a time, both of common lines and at
+// first of the lines searched for the next line found once in each text.
+static const int hunkPullLines = 64;
+
+// Offset just past the line of a text starting at pos.
+static int lineEnd(const std::wstring &text, int pos)
+{
+  const size_t end = text.find(L'\n', pos);
+  return end == std::wstring::npos ? text.length() : end + 1;
+}
+
+
+bool DiffHunks::pull() {
+  const int length1 = text1.length();
+  const int length2 = text2.length();
+  if (pulled1 == length1 && pulled2 == length2) {
+    return false;
+  }
+  auto add = [this](Diff::Operation op, int length) {
+    if (length == 0) {
+      return;
+    }
+    if (!lineDiffs.empty() && lineDiffs.back().first == op) {
+      lineDiffs.back().second += length;
+    } else {
+      lineDiffs.push_back(std::make_pair(op, length));
+    }
+  };
+
+  // The lines the texts have in common, a few at a time.
+  int equal = 0;
+  int lines = 0;
+  for (; pulled1 + equal < length1 && pulled2 + equal < length2; lines++) {
+    if (lines == hunkPullLines) {
+      add(Diff::Operation::Equal, equal);
+      pulled1 += equal;
+      pulled2 += equal;
+      return true;
+    }
+    const int length = lineEnd(text1, pulled1 + equal) - (pulled1 + equal);
+    if (length != lineEnd(text2, pulled2 + equal) - (pulled2 + equal)
+        || text1.compare(pulled1 + equal, length, text2, pulled2 + equal, length) != 0) {
+      break;
+    }
+    equal += length;
+  }
+  add(Diff::Operation::Equal, equal);
+  pulled1 += equal;
+  pulled2 += equal;
+
+  // Find the nearest line found once in each of the next lines of both
+  // texts, doubling how many are looked at until there is one.
+  int end1 = length1;
+  int end2 = length2;
+  if (pulled1 < length1 && pulled2 < length2) {
+    for (int window = hunkPullLines; ; window *= 2) {
+      int last1 = pulled1;
+      int last2 = pulled2;
+      for (int i = 0; i < window && last1 < length1; i++) {
+        last1 = lineEnd(text1, last1);
+      }
+      for (int i = 0; i < window && last2 < length2; i++) {
+        last2 = lineEnd(text2, last2);
+      }
+      const std::wstring window1 = text1.substr(pulled1, last1 - pulled1);
+      const std::wstring window2 = text2.substr(pulled2, last2 - pulled2);
+      const LineCounts counts(window1, window2);
+      int best = -1;
+      for (int i = 0; i + 1 < static_cast<int>(counts.lines1.size()); i++) {
+        if (best != -1 && i >= best) {
+          break;
+        }
+        const int j = counts.anchor(i);
+        if (j != -1 && (best == -1 || i + j < best)) {
+          best = i + j;
+          end1 = pulled1 + counts.lines1[i];
+          end2 = pulled2 + counts.lines2[j];
+        }
+      }
+      if (best != -1 || (last1 == length1 && last2 == length2)) {
+        break;
+      }
+    }
+  }
+
+  // Line-diff the stretch up to there.
+  const std::wstring stretch1 = text1.substr(pulled1, end1 - pulled1);
+  const std::wstring stretch2 = text2.substr(pulled2, end2 - pulled2);
+  if (stretch1.empty() || stretch2.empty()) {
+    add(Diff::Operation::Delete, stretch1.length());
+    add(Diff::Operation::Insert, stretch2.length());
+  } else {
+    const auto b = dmp.diff_linesToChars(stretch1, stretch2);
+    const std::deque<std::wstring> &lineArray = std::get<2>(b);
+    for (const Diff &aDiff : dmp.diff_main(std::get<0>(b), std::get<1>(b), false)) {
+      int length = 0;
+      for (wchar_t c : aDiff.text) {
+        length += lineArray[static_cast<unsigned short>(c)].length();
+      }
+      add(aDiff.operation, length);
+    }
+  }
+  pulled1 = end1;
+  pulled2 = end2;
+  return true;
+}
+
+
+/////////////////////////////////////////////
+//
+// IncrementalDiff Class
+//
+/////////////////////////////////////////////
+
+
+IncrementalDiff::IncrementalDiff(const diff_match_patch &_dmp,
+                                 const std::wstring &_text1,
+                                 const std::wstring &_text2) :
+  dmp(_dmp) {
+  texts[0] = _text1;
+  texts[1] = _text2;
+  diffList = dmp.diff_main(_text1, _text2);
+  reindex(0);
+}
+
+
+void IncrementalDiff::replace1(int offset, int length, const std::wstring &text) {
+  replace(0, offset, length, text);
+}
+
+
+void IncrementalDiff::replace2(int offset, int length, const std::wstring &text) {
+  replace(1, offset, length, text);
+}
+
+
+const std::wstring &IncrementalDiff::text1() const {
+  return texts[0];
+}
+
+
+const std::wstring &IncrementalDiff::text2() const {
+  return texts[1];
+}
+
+
+const std::deque<Diff> &IncrementalDiff::diffs() const {
+  return diffList;
+}
+
+
+void IncrementalDiff::replace(int side, int offset, int length,
+                              const std::wstring &text) {
+  if (offset < 0 || length < 0 || offset + length > static_cast<int>(texts[side].length())) {
+    throw std::wstring(L"Edit out of range.");
+  }
+  const std::vector<int> &sideStarts = starts[side];
+  const int count = diffList.size();
+  const int end = offset + length;
+
+  // The nearest equality starting before the edit, cut a margin before it.
+  // Cuts never fall on an edge of an equality, so the parts kept on either
+  // side of the region are non-empty equalities.
+  int left = std::lower_bound(sideStarts.begin(), sideStarts.begin() + count, offset)
+      - sideStarts.begin() - 1;
+  while (left >= 0 && diffList[left].operation != Diff::Operation::Equal) {
+    left--;
+  }
+  int leftCut = 0;  // Characters of diffList[left] kept.
+  if (left >= 0) {
+    leftCut = std::max(1, std::min(sideStarts[left + 1], offset) - Margin - sideStarts[left]);
+  }
+  // The nearest equality ending after the edit, cut a margin after it.
+  int right = std::upper_bound(sideStarts.begin() + 1, sideStarts.end(), end)
+      - sideStarts.begin() - 1;
+  while (right < count && diffList[right].operation != Diff::Operation::Equal) {
+    right++;
+  }
+  int rightCut = 0;  // Characters of diffList[right] not kept.
+  if (right < count) {
+    rightCut = std::min(static_cast<int>(diffList[right].text.length()) - 1,
+                        std::max(sideStarts[right], end) + Margin - sideStarts[right]);
+  }
+
+  // Locate the region in both texts.
+  int region[2][2];
+  for (int x = 0; x < 2; x++) {
+    region[x][0] = left >= 0 ? starts[x][left] + leftCut : 0;
+    region[x][1] = right < count ? starts[x][right] + rightCut : texts[x].length();
+  }
+
+  // Apply the edit and rediff the region.
+  texts[side].replace(offset, length, text);
+  region[side][1] += static_cast<int>(text.length()) - length;
+  std::deque<Diff> regionDiffs = dmp.diff_main(
+      texts[0].substr(region[0][0], region[0][1] - region[0][0]),
+      texts[1].substr(region[1][0], region[1][1] - region[1][0]));
+
+  // Trim the bounding equalities down to their outer parts, in place, and
+  // fold the region's own leading and trailing equalities into them.
+  const bool hasRight = right < count;
+  if (left >= 0 && left == right) {
+    // The edit lies within a single equality; split it.
+    const Diff equality = diffList[right];
+    diffList.insert(diffList.begin() + right + 1, equality);
+    right++;
+  }
+  if (left >= 0) {
+    std::wstring &kept = diffList[left].text;
+    kept.resize(leftCut);
+    if (!regionDiffs.empty() && regionDiffs.front().operation == Diff::Operation::Equal) {
+      kept += regionDiffs.front().text;
+      regionDiffs.pop_front();
+    }
+  }
+  if (hasRight) {
+    std::wstring &kept = diffList[right].text;
+    kept.erase(0, rightCut);
+    if (!regionDiffs.empty() && regionDiffs.back().operation == Diff::Operation::Equal) {
+      kept.insert(0, regionDiffs.back().text);
+      regionDiffs.pop_back();
+    }
+  }
+
+  // Splice the region in place of the diffs between the equalities.
+  diffList.erase(diffList.begin() + left + 1, diffList.begin() + right);
+  if (!regionDiffs.empty()) {
+    // Inserting an empty range mid-deque can self-move-assign elements.
+    diffList.insert(diffList.begin() + left + 1, regionDiffs.begin(), regionDiffs.end());
+  } else if (left >= 0 && hasRight) {
+    // Nothing is left between the two equalities; merge them.
+    diffList[left].text += diffList[left + 1].text;
+    diffList.erase(diffList.begin() + left + 1);
+  }
+  reindex(std::max(left, 0));
+}
+
+
+void IncrementalDiff::reindex(int from) {
+  for (int x = 0; x < 2; x++) {
+    std::vector<int> &sideStarts = starts[x];
+    sideStarts.resize(diffList.size() + 1);
+    if (from == 0) {
+      sideStarts[0] = 0;
+    }
+    const Diff::Operation skipped = x == 0 ? Diff::Operation::Insert : Diff::Operation::Delete;
+    for (size_t i = from; i < diffList.size(); i++) {
+      sideStarts[i + 1] = sideStarts[i]
+          + (diffList[i].operation == skipped ? 0 : diffList[i].text.length());
+    }
+  }
+}
+
+
+/////////////////////////////////////////////
+//
+// DiffCache Class
+//
+/////////////////////////////////////////////
+
+
+DiffCache::DiffCache(size_t _byteBudget) :
+  byteBudget(_byteBudget), usedBytes(0), hitCount(0), missCount(0) {
+}
+
+
+std::deque<Diff> DiffCache::diff_main(const diff_match_patch &dmp,
+                                      const std::wstring &text1,
+                                      const std::wstring &text2,
+                                      bool checklines) {
+  Entry entry;
+  entry.key = makeKey(Kind::Diff, dmp, checklines, text1, text2);
+  if (std::shared_ptr<const Entry> found = lookup(entry.key)) {
+    return found->diffs;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  entry.diffs = dmp.diff_main(text1, text2, checklines);
+  entry.bytes = sizeof(Entry);
+  for (const Diff &aDiff : entry.diffs) {
+    entry.bytes += sizeof(Diff) + aDiff.text.length() * sizeof(wchar_t);
+  }
+  std::deque<Diff> diffs = entry.diffs;
+  store(std::move(entry), dmp, start);
+  return diffs;
+}
+
+
+std::deque<Patch> DiffCache::patch_make(const diff_match_patch &dmp,
+                                        const std::wstring &text1,
+                                        const std::wstring &text2) {
+  Entry entry;
+  entry.key = makeKey(Kind::Patch, dmp, true, text1, text2);
+  if (std::shared_ptr<const Entry> found = lookup(entry.key)) {
+    return found->patches;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  entry.patches = dmp.patch_make(text1, text2);
+  entry.bytes = sizeof(Entry);
+  for (const Patch &aPatch : entry.patches) {
+    entry.bytes += sizeof(Patch);
+    for (const Diff &aDiff : aPatch.diffs) {
+      entry.bytes += sizeof(Diff) + aDiff.text.length() * sizeof(wchar_t);
+    }
+  }
+  std::deque<Patch> patches = entry.patches;
+  store(std::move(entry), dmp, start);
+  return patches;
+}
+
+
+std::wstring DiffCache::diff_toDelta(const diff_match_patch &dmp,
+                                     const std::wstring &text1,
+                                     const std::wstring &text2,
+                                     bool checklines) {
+  Entry entry;
+  entry.key = makeKey(Kind::Delta, dmp, checklines, text1, text2);
+  if (std::shared_ptr<const Entry> found = lookup(entry.key)) {
+    return found->delta;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  entry.delta = dmp.diff_toDelta(dmp.diff_main(text1, text2, checklines));
+  entry.bytes = sizeof(Entry) + entry.delta.length() * sizeof(wchar_t);
+  std::wstring delta = entry.delta;
+  store(std::move(entry), dmp, start);
+  return delta;
+}
+
+
+size_t DiffCache::hits() const {
+  return hitCount;
+}
+
+
+size_t DiffCache::misses() const {
+  return missCount;
+}
+
+
+size_t DiffCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return usedBytes;
+}
+
+
+void DiffCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  usedBytes = 0;
+}
+
+
+DiffCache::Key DiffCache::makeKey(Kind kind, const diff_match_patch &dmp,
+                                  bool checklines, const std::wstring &text1,
+                                  const std::wstring &text2) {
+  // Only the settings which can change the result take part in the key, so
+  // that tuning matching doesn't throw away cached diffs.
+  std::vector<double> settings;
+  settings.push_back(static_cast<double>(kind));
+  settings.push_back(dmp.Diff_Timeout);
+  settings.push_back(checklines ? 1.0 : 0.0);
+  settings.push_back(static_cast<double>(dmp.Diff_Algorithm));
+  settings.push_back(dmp.Diff_Anchoring ? 1.0 : 0.0);
+  settings.push_back(dmp.Diff_LineModeLength);
+  settings.push_back(static_cast<double>(dmp.Diff_BitParallelCells));
+  settings.push_back(dmp.Diff_ONPRatio);
+  settings.push_back(dmp.Diff_Race ? dmp.Diff_RaceSlack : -1.0);
+  if (dmp.Diff_Algorithm == diff_match_patch::DiffAlgorithm::Auto) {
+    settings.push_back(dmp.Diff_WordModeLineLength);
+    settings.push_back(dmp.Diff_MinTokenAlphabet);
+    settings.push_back(dmp.Diff_AnchorMinLines);
+    settings.push_back(dmp.Diff_AnchorSimilarity);
+  }
+  if (kind == Kind::Patch) {
+    settings.push_back(dmp.Diff_EditCost);
+    settings.push_back(dmp.Patch_Margin);
+    settings.push_back(dmp.Match_MaxBits);
+  }
+  uint64_t h1 = 0, h2 = 0;
+  hash128(settings.data(), settings.size() * sizeof(double), h1, h2);
+  hash128(text1.data(), text1.length() * sizeof(wchar_t), h1, h2);
+  hash128(text2.data(), text2.length() * sizeof(wchar_t), h1, h2);
+  Key key;
+  key.lo = h1;
+  key.hi = h2;
+  return key;
+}
+
+
+std::shared_ptr<const DiffCache::Entry> DiffCache::lookup(const Key &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = index.find(key);
+  if (found == index.end()) {
+    missCount++;
+    return nullptr;
+  }
+  // Move to the front of the recency list.
+  entries.splice(entries.begin(), entries, found->second);
+  hitCount++;
+  return entries.front();
+}
+
+
+void DiffCache::store(Entry &&entry, const diff_match_patch &dmp,
+                      std::chrono::steady_clock::time_point start) {
+  if (dmp.Diff_Timeout > 0) {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed.count() >= dmp.Diff_Timeout) {
+      // The diff may have been cut short; don't replay it.
+      return;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  if (entry.bytes > byteBudget || index.count(entry.key) != 0) {
+    // Too big to keep, or another thread got there first.
+    return;
+  }
+  usedBytes += entry.bytes;
+  entries.push_front(std::make_shared<const Entry>(std::move(entry)));
+  index[entries.front()->key] = entries.begin();
+  while (usedBytes > byteBudget) {
+    usedBytes -= entries.back()->bytes;
+    index.erase(entries.back()->key);
+    entries.pop_back();
+  }
+}
@@ -18,12 +18,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <tuple>
 #include <regex>
 #include <map>
+#include <unordered_map>
 
 /*
  * Functions for diff, match and patch.
@@ -113,19 +121,18 @@ class Patch {
 };
 
 
-/**
- * Class containing the diff, match and patch methods.
- * Also contains the behaviour settings.
- */
-class diff_match_patch {
+class DiffHunks;
 
-  friend class diff_match_patch_test;
 
- public:
+/**
+ * Behaviour settings for the diff, match and patch methods.
+ */
+struct DiffMatchPatchOptions {
   // Defaults.
   // Set these on your diff_match_patch instance to override the defaults.
 
   // Number of seconds to map a diff before giving up (0 for infinity).
+  // Counted in wall-clock time, so diffs running at once each get it all.
   float Diff_Timeout;
   // Cost of an empty edit operation in terms of edit characters.
   short Diff_EditCost;
@@ -142,19 +149,339 @@ class diff_match_patch {
   float Patch_DeleteThreshold;
   // Chunk size for context length.
   short Patch_Margin;
+  // patch_apply indexes the text by substrings of this length, to find
+  // matches without scanning the whole search window (0 = no index).
+  int Patch_IndexGram;
 
-  // The number of bits in an int.
+  // Longest pattern match_bitap will take, and so the most text a patch may
+  // span.  Patterns up to 64 characters take one machine
+  // word, longer ones a vector of them.
   short Match_MaxBits;
+  // Engine behind match_main's fuzzy search.  Both score matches alike.
+  enum class MatchAlgorithm {
+    Bitap,  // Wu & Manber's Bitap, one pass over the text per error level.
+    Myers   // Myers' bit-vector edit distance, one pass whatever the errors.
+  };
+  MatchAlgorithm Match_Algorithm;
+
+  // Algorithm used to find the differences once the speedups have run out.
+  enum class DiffAlgorithm {
+    Myers,      // Myers' O(ND) bisection, with the O(NP) and bit-parallel
+                // engines standing in where they are known to be faster.
+    Histogram,  // Histogram diff to align lines, otherwise as Myers.
+    ONP,        // Wu, Manber & Myers' O(NP) for everything.
+    Auto        // Let the planner pick from the shape of the texts.
+  };
+  DiffAlgorithm Diff_Algorithm;
+  // Before searching for differences, split the texts around the lines which
+  // occur once in each of them (as in patience diff).
+  bool Diff_Anchoring;
+
+  // Planner thresholds.  The defaults come from tests/dmp_bench.cpp, which
+  // can be rerun to calibrate them for a particular machine.
+  // Line mode is used once both texts are longer than this.
+  int Diff_LineModeLength;
+  // Largest text1 x text2 area diffed with bit vectors rather than bisection.
+  int64_t Diff_BitParallelCells;
+  // Texts whose lengths differ by this factor or more are diffed in O(NP).
+  float Diff_ONPRatio;
+  // Auto: lines longer than this on average are diffed word by word instead.
+  int Diff_WordModeLineLength;
+  // Auto: texts using fewer distinct characters are never split into lines
+  // or words.
+  int Diff_MinTokenAlphabet;
+  // Auto: anchor on unique lines when both texts have this many lines and
+  // at least Diff_AnchorSimilarity of sampled lines reappear in text2.
+  int Diff_AnchorMinLines;
+  float Diff_AnchorSimilarity;
+  // Diff with several strategies at once, one thread each, and keep the first
+  // diff whose edit cost is within Diff_RaceSlack (0.1 = 10%) of a lower
+  // bound on it; failing that, the cheapest diff in by the time the diff as
+  // configured is done, when the rest are called off and left to quit on
+  // their own.  The bound only counts characters, so moved lines never reach
+  // it.  No more strategies run than there are cores, and none but the
+  // configured one on a single core.  Trades CPU for latency, and which diff
+  // wins may vary from run to run.
+  // The contenders share one Diff_Timeout.  The streaming diff_main never
+  // races: each contender's diff would have to be held whole to be costed.
+  bool Diff_Race;
+  float Diff_RaceSlack;
+
+  DiffMatchPatchOptions();
+};
+
+
+/**
+ * How a pair of texts gets diffed once the common prefix and suffix are
+ * gone, and why.  Returned by diff_match_patch::diff_plan.
+ */
+struct DiffPlan {
+  enum class Strategy {
+    Trivial,      // Settled by the speedups (empty, contained or single char).
+    LineMode,     // Line-level diff, then rediff of the changed blocks.
+    WordMode,     // Word-level diff, then rediff of the changed blocks.
+    BitParallel,  // Bit-parallel LCS.
+    ONP,          // Wu, Manber & Myers' O(NP).
+    Bisect        // Myers' O(ND) bisection.
+  };
+
+  Strategy strategy;
+  // Splitting around unique lines is tried before the strategy.
+  bool anchored;
+  // Splitting around a long common substring is tried before the strategy.
+  bool halfMatch;
+
+  // Signals the decision was based on.
+  int length1;
+  int length2;
+  // Lines of each text (0 if line mode was ruled out without counting).
+  int lines1;
+  int lines2;
+  // Share of sampled lines of text1 which also occur in text2 (-1 if the
+  // planner had no use for it).
+  float lineSimilarity;
+  // Distinct characters in a sample of both texts (-1 if not measured).
+  int alphabet;
+
+  std::wstring reason;
+
+  DiffPlan();
+  static std::wstring strStrategy(Strategy strategy);
+  std::wstring toString() const;
+};
+
+
+/**
+ * Size of a diff, without its text.  Returned by diff_match_patch::diff_stats.
+ */
+struct DiffStats {
+  // Characters kept, deleted from text1 and inserted into text2.
+  long equalChars;
+  long deletedChars;
+  long insertedChars;
+  // Lines of each text, counting a final line without a newline.
+  long lines1;
+  long lines2;
+  // Lines of text1 with a deleted character, of text2 with an inserted one.
+  long deletedLines;
+  long insertedLines;
+  // Runs of insertions and deletions between equalities.
+  int hunks;
+  // As diff_match_patch::diff_levenshtein.
+  long levenshtein;
+
+  DiffStats();
+  std::wstring toString() const;
+};
+
+
+/**
+ * A place a pattern matches.  Returned by diff_match_patch::match_candidates.
+ */
+struct MatchCandidate {
+  int location;
+  // As diff_match_patch::match_bitapScore (0.0 = perfect).
+  double score;
+  // Fewest edits turning the pattern into the text there.
+  int errors;
+};
+
+
+/**
+ * The alphabet of a match pattern compiled for the Bitap search: the same
+ * masks as diff_match_patch::match_alphabet, but found with a single load.
+ * Characters below 128 index a table directly; the pattern's others go in a
+ * small perfect hash.
+ */
+class MatchAlphabet {
+ public:
+  /**
+   * Constructor.  Compiles the alphabet of a pattern.
+   * @param pattern The text to encode.
+   */
+  explicit MatchAlphabet(const std::wstring &pattern);
+
+  /**
+   * @return Number of 64-bit words in each mask.
+   */
+  int words() const;
+
+  /**
+   * Look up the mask of a character: bit i is set where the character is i
+   * places from the end of the pattern.
+   * @param c Character to look up.
+   * @return The mask's words, least significant first; all zero for
+   *     characters not in the pattern.
+   */
+  const uint64_t *operator[](wchar_t c) const;
+
+ private:
+  int maskWords;
+  // Masks of the characters below 128.
+  std::vector<uint64_t> ascii;
+  // Masks of the other characters, in slot (c * multiplier) >> shift, which
+  // is different for each character of the pattern.
+  std::vector<wchar_t> keys;
+  std::vector<uint64_t> masks;
+  uint32_t multiplier;
+  int shift;
+  std::vector<uint64_t> none;
+};
+
+
+/**
+ * A match pattern compiled once for any number of searches: its alphabet,
+ * and the part of the score each number of errors costs.  Taken by
+ * diff_match_patch::match_main in place of the pattern's text.
+ */
+class MatchPattern {
+ public:
+  /**
+   * Constructor.  Compiles a pattern.
+   * @param pattern The text to search for.
+   */
+  explicit MatchPattern(const std::wstring &pattern);
+
+  /**
+   * @return The pattern's text.
+   */
+  const std::wstring &text() const;
+
+  /**
+   * @return The pattern's alphabet.
+   */
+  const MatchAlphabet &alphabet() const;
+
+  /**
+   * @param e Number of errors in a match.
+   * @return Accuracy part of its score, as diff_match_patch::match_bitapScore.
+   */
+  float accuracy(int e) const;
+
+ private:
+  std::wstring pattern;
+  MatchAlphabet masks;
+  std::vector<float> accuracies;
+};
+
+
+/**
+ * A text prepared for repeated fuzzy matches: the positions of each of its
+ * substrings of a fixed length (q-grams).  diff_match_patch::match_main then
+ * only searches around where pieces of the pattern occur exactly, which no
+ * match with few enough errors can avoid.  Edits keep the index up to date.
+ */
+class MatchIndex {
+ public:
+  /**
+   * Constructor.  Indexes a text.
+   * @param text The text to index.
+   * @param gramLength Length of the indexed substrings, or 0 not to index.
+   */
+  MatchIndex(const std::wstring &text, int gramLength);
+
+  /**
+   * @return The text as edited so far.
+   */
+  const std::wstring &text() const;
+
+  /**
+   * @return Length of the indexed substrings, or 0 if none are.
+   */
+  int gramLength() const;
+
+  /**
+   * Replace part of the text, reindexing only the substrings it touches.
+   * @param pos Start of the part to replace.
+   * @param count Length of the part to replace.
+   * @param replacement The new text.
+   */
+  void replace(size_t pos, size_t count, const std::wstring &replacement);
+
+  /**
+   * Count where a substring may occur: at least as often as it does.
+   * @param gram Start of a substring of gramLength() characters.
+   * @return Number of positions.
+   */
+  size_t count(const wchar_t *gram) const;
+
+  /**
+   * Find where a substring may occur within a span: a superset of where it
+   * does.
+   * @param gram Start of a substring of gramLength() characters.
+   * @param from First position of the span.
+   * @param to Last position of the span.
+   * @param found Receives the positions, in ascending order.
+   */
+  void find(const wchar_t *gram, int from, int to, std::vector<int> &found) const;
+
+ private:
+  friend class diff_match_patch_test;
+
+  std::wstring content;
+  int length;
+  // The text is cut into blocks of at most matchIndexBlock characters, and a
+  // position kept as its block and the offset into it, so that an edit only
+  // moves the starts of the blocks after it.  Blocks are numbered in no
+  // particular order, so that one which an edit grows can be split without
+  // renumbering the rest.  blockStarts holds the start of each by number,
+  // and blockOrder their numbers in the order of the text, with the end of
+  // the text last.
+  std::vector<int> blockStarts;
+  std::vector<uint32_t> blockOrder;
+  // Each substring's positions, in ascending order.
+  std::unordered_map<uint64_t, std::vector<uint64_t>> postings;
+
+  uint64_t key(const wchar_t *gram) const;
+  uint64_t locate(int pos) const;
+  size_t order(int pos) const;
+  int position(uint64_t entry) const;
+  void add(int begin, int end);
+  void remove(int begin, int end);
+};
+
+
+/**
+ * Class containing the diff, match and patch methods.
+ * Also contains the behaviour settings.
+ *
+ * All methods are const and keep no state between calls, so one instance may
+ * be shared by any number of threads as long as its settings are left alone
+ * while they use it.  To run a single call with different settings, build a
+ * temporary engine from a modified copy of the options:
+ *   diff_match_patch::Options options = dmp.options();
+ *   options.Diff_Timeout = 0;
+ *   diff_match_patch(options).diff_main(text1, text2);
+ */
+class diff_match_patch : public DiffMatchPatchOptions {
+
+  friend class diff_match_patch_test;
+  friend class DiffHunks;
+
+ public:
+  typedef DiffMatchPatchOptions Options;
 
  private:
   // Define some regex patterns for matching boundaries.
-  static std::wregex BLANKLINEEND;
-  static std::wregex BLANKLINESTART;
+  static const std::wregex BLANKLINEEND;
+  static const std::wregex BLANKLINESTART;
+
+  // Lines repeated more often than this are never used as histogram anchors.
+  static const int Histogram_MaxOccurrences = 64;
+  // Most snakes diff_onp will remember before giving up on it.
+  static const size_t ONP_MaxPath = 1 << 22;
 
 
  public:
 
   diff_match_patch();
+  explicit diff_match_patch(const Options &options);
+
+  /**
+   * The behaviour settings of this instance.
+   * @return Options used by every method.
+   */
+  const Options &options() const;
 
   //  DIFF FUNCTIONS
 
@@ -168,7 +495,7 @@ class diff_match_patch {
    * @param text2 New string to be diffed.
    * @return Linked List of Diff objects.
    */
-  std::deque<Diff> diff_main(const std::wstring &text1, const std::wstring &text2);
+  std::deque<Diff> diff_main(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Find the differences between two texts.
@@ -179,7 +506,90 @@ class diff_match_patch {
    *     If true, then run a faster slightly less optimal diff.
    * @return Linked List of Diff objects.
    */
-  std::deque<Diff> diff_main(const std::wstring &text1, const std::wstring &text2, bool checklines);
+  std::deque<Diff> diff_main(const std::wstring &text1, const std::wstring &text2, bool checklines) const;
+
+  /**
+   * Receiver for a streamed diff.  Called once per diff operation, in order.
+   */
+  typedef std::function<void(Diff::Operation operation, const std::wstring &text)> DiffSink;
+
+  /**
+   * Find the differences between two texts and stream them into a sink.
+   * Each region of the diff (common prefix/suffix, half-match pieces,
+   * line-mode blocks) is handed to the sink as soon as it is complete, so the
+   * full list of diffs is never held in memory.  Empty texts are never
+   * emitted and no two consecutive calls share an operation.  Edits are not
+   * shifted across region boundaries, and line mode cleans up its line-level
+   * diff counting lines rather than characters, so the result may differ
+   * from diff_main's, but it always describes text1 -> text2.  Diff_Race is
+   * ignored, since racing means holding each contender's whole diff.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag.  If false, then don't run a
+   *     line-level diff first to identify the changed areas.
+   *     If true, then run a faster slightly less optimal diff.
+   * @param sink Receiver of the diff operations.
+   */
+  void diff_main(const std::wstring &text1, const std::wstring &text2, bool checklines, const DiffSink &sink) const;
+
+  /**
+   * Find the differences between two texts which are known to be close,
+   * giving up as soon as more than maxEdits characters would have to be
+   * inserted or deleted.  Only diagonals within the band that many edits
+   * allow are explored, in O((N+M)*maxEdits) time and O(maxEdits) memory,
+   * and the result is a minimal diff.  Diff_Timeout does not apply.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param maxEdits Most characters the diff may insert and delete in all.
+   * @param diffs Set to the Linked List of Diff objects if within bounds.
+   * @return False if the texts are more than maxEdits apart.
+   */
+  bool diff_bounded(const std::wstring &text1, const std::wstring &text2, int maxEdits, std::deque<Diff> &diffs) const;
+
+  /**
+   * Check whether two texts are within a Levenshtein distance (insertions,
+   * deletions and substitutions of single characters) of each other, without
+   * building a diff.  Stops as soon as the distance is shown to be too large.
+   * @param text1 First string.
+   * @param text2 Second string.
+   * @param maxEdits Largest distance allowed.
+   * @return True if the texts are at most maxEdits apart.
+   */
+  bool diff_similarWithin(const std::wstring &text1, const std::wstring &text2, int maxEdits) const;
+
+  /**
+   * Measure the differences between two texts.  Runs diff_main and counts
+   * its diffs, so the figures are exactly those of diff_main, diff_text1,
+   * diff_text2 and diff_levenshtein on the same texts; only the counts are
+   * returned, and no further text is built from the diffs.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag, as for diff_main.
+   * @return The counts.
+   */
+  DiffStats diff_stats(const std::wstring &text1, const std::wstring &text2, bool checklines = true) const;
+
+  /**
+   * Find the differences between many pairs of texts at once.  The pairs are
+   * shared out among a number of worker threads, most expensive first, so
+   * that one large pair doesn't leave the other threads idle at the end.
+   * Each pair gets its own Diff_Timeout.
+   * @param pairs Old and new strings to be diffed.
+   * @param threads Number of threads to use, or 0 for one per hardware thread.
+   * @return One Linked List of Diff objects per pair, in input order.
+   */
+  std::vector<std::deque<Diff>> diff_batch(const std::vector<std::pair<std::wstring, std::wstring>> &pairs, int threads = 0) const;
+
+  /**
+   * Describe how diff_main would go about diffing two texts: which strategy
+   * it would pick for what is left after trimming their common prefix and
+   * suffix, the signals that choice was based on and the reasoning.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag, as for diff_main.
+   * @return The plan.
+   */
+  DiffPlan diff_plan(const std::wstring &text1, const std::wstring &text2, bool checklines = true) const;
 
   /**
    * Find the differences between two texts.  Simplifies the problem by
@@ -194,7 +604,20 @@ class diff_match_patch {
    * @return Linked List of Diff objects.
    */
  private:
-  std::deque<Diff> diff_main(const std::wstring &text1, const std::wstring &text2, bool checklines, clock_t deadline);
+  std::deque<Diff> diff_main(const std::wstring &text1, const std::wstring &text2, bool checklines, clock_t deadline) const;
+
+  /**
+   * Race diff_main's strategies against each other on separate threads (see
+   * Diff_Race).  The losers are cancelled as soon as a good enough diff, or
+   * the diff as configured, is in.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag, as for diff_main.
+   * @param deadline Time when the diff should be complete by.
+   * @return Linked List of Diff objects.
+   */
+ private:
+  std::deque<Diff> diff_race(const std::wstring &text1, const std::wstring &text2, bool checklines, clock_t deadline) const;
 
   /**
    * Find the differences between two texts.  Assumes that the texts do not
@@ -208,7 +631,43 @@ class diff_match_patch {
    * @return Linked List of Diff objects.
    */
  private:
-  std::deque<Diff> diff_compute(std::wstring text1, std::wstring text2, bool checklines, clock_t deadline);
+  std::deque<Diff> diff_compute(std::wstring text1, std::wstring text2, bool checklines, clock_t deadline) const;
+
+  /**
+   * Streaming counterpart of diff_main with a deadline.  Trims the common
+   * prefix and suffix and emits the diff of the remainder region by region.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag.
+   * @param deadline Time when the diff should be complete by.
+   * @param emit Receiver of the (possibly uncoalesced) diff operations.
+   */
+ private:
+  void diff_stream(const std::wstring &text1, const std::wstring &text2, bool checklines, clock_t deadline, const DiffSink &emit) const;
+
+  /**
+   * Streaming counterpart of diff_compute.  Assumes that the texts do not
+   * have any common prefix or suffix.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag.
+   * @param deadline Time when the diff should be complete by.
+   * @param emit Receiver of the (possibly uncoalesced) diff operations.
+   */
+ private:
+  void diff_streamCompute(const std::wstring &text1, const std::wstring &text2, bool checklines, clock_t deadline, const DiffSink &emit) const;
+
+  /**
+   * Streaming counterpart of diff_lineMode.  The line-level diff stays
+   * encoded; each replacement block is converted back, rediffed and emitted
+   * before the next one is looked at.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param deadline Time when the diff should be complete by.
+   * @param emit Receiver of the (possibly uncoalesced) diff operations.
+   */
+ private:
+  void diff_streamLineMode(const std::wstring &text1, const std::wstring &text2, clock_t deadline, const DiffSink &emit) const;
 
   /**
    * Do a quick line-level diff on both strings, then rediff the parts for
@@ -220,7 +679,105 @@ class diff_match_patch {
    * @return Linked List of Diff objects.
    */
  private:
-  std::deque<Diff> diff_lineMode(std::wstring text1, std::wstring text2, clock_t deadline);
+  std::deque<Diff> diff_lineMode(std::wstring text1, std::wstring text2, clock_t deadline) const;
+
+  /**
+   * Do a quick word-level diff on both strings, then rediff the parts for
+   * greater accuracy.  Suits long lines, where line mode finds nothing.
+   * This speedup can produce non-minimal diffs.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param deadline Time when the diff should be complete by.
+   * @return Linked List of Diff objects.
+   */
+ private:
+  std::deque<Diff> diff_wordMode(const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
+
+  /**
+   * Diff two texts encoded as token characters, convert the diff back to
+   * text and rediff the replacement blocks character by character.
+   * @param encoded Encoded texts and token array, as from diff_linesToChars.
+   * @param deadline Time when the diff should be complete by.
+   * @return Linked List of Diff objects.
+   */
+ private:
+  std::deque<Diff> diff_tokenMode(const std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> &encoded, clock_t deadline) const;
+
+  /**
+   * Diff two texts encoded by diff_linesToChars with the line alignment
+   * algorithm chosen by Diff_Algorithm.
+   * @param text1 Old string of line characters.
+   * @param text2 New string of line characters.
+   * @param deadline Time when the diff should be complete by.
+   * @return Linked List of Diff objects.
+   */
+ private:
+  std::deque<Diff> diff_lines(const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
+
+  /**
+   * Find the differences between two sequences of lines (or other tokens)
+   * encoded as characters, the way git's histogram diff does.  The longest
+   * common run of the least repeated lines is taken as an anchor and the
+   * regions on either side are diffed in turn.  Regions with no line that
+   * occurs at most Histogram_MaxOccurrences times are handed to Myers.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param deadline Time at which to bail out.
+   * @return Linked List of Diff objects.
+   */
+ protected:
+  std::deque<Diff> diff_histogram(const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
+
+  /**
+   * Find the differences between two texts from a longest common subsequence
+   * computed with bit vectors (Allison-Dix / Hyyro), 64 columns of the LCS
+   * table per machine word.  Memory and time grow with the product of the
+   * lengths, so diff_compute only uses it while that product is at most
+   * Diff_BitParallelCells.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param deadline Time at which to bail if not yet complete.
+   * @return Linked List of Diff objects.
+   */
+ protected:
+  std::deque<Diff> diff_bitParallel(const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
+
+  /**
+   * Decide how to diff two texts which the speedups in diff_compute could
+   * not settle.  Assumes that the texts do not have any common prefix or
+   * suffix.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag.
+   * @return The plan.
+   */
+ private:
+  DiffPlan diff_planCompute(const std::wstring &text1, const std::wstring &text2, bool checklines) const;
+
+  /**
+   * Run one of the character-level engines of a plan.
+   * @param strategy BitParallel, ONP or Bisect.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param deadline Time at which to bail out.
+   * @return Linked List of Diff objects.
+   */
+ private:
+  std::deque<Diff> diff_engine(DiffPlan::Strategy strategy, const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
+
+  /**
+   * Find the differences between two texts with Wu, Manber and Myers' O(NP)
+   * algorithm, where P is the number of deletions from the longer text.  Much
+   * faster than diff_bisect when one text is far longer than the other.  Falls
+   * back on diff_bisect if the edit path grows too large to keep.
+   * See Wu et al. 1990: An O(NP) Sequence Comparison Algorithm.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param deadline Time at which to bail out.
+   * @return Linked List of Diff objects.
+   */
+ protected:
+  std::deque<Diff> diff_onp(const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
 
   /**
    * Find the 'middle snake' of a diff, split the problem in two
@@ -231,7 +788,33 @@ class diff_match_patch {
    * @return Linked List of Diff objects.
    */
  protected:
-  std::deque<Diff> diff_bisect(const std::wstring &text1, const std::wstring &text2, clock_t deadline);
+  std::deque<Diff> diff_bisect(const std::wstring &text1, const std::wstring &text2, clock_t deadline) const;
+
+  /**
+   * Search for the 'middle snake' of a diff, up to a number of steps in from
+   * each end.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param max_d Number of steps to take from each end at most.
+   * @param deadline Time at which to bail if not yet complete.
+   * @param x Set to the index of the split point in text1.
+   * @param y Set to the index of the split point in text2.
+   * @return Number of characters the diff inserts and deletes, or -1 if the
+   *     paths never met.
+   */
+ private:
+  int diff_bisectMiddle(const std::wstring &text1, const std::wstring &text2, int max_d, clock_t deadline, int &x, int &y) const;
+
+  /**
+   * Append the diff of two texts to a list, if within the edit bound.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param maxEdits Most characters the diff may insert and delete in all.
+   * @param diffs Linked List of Diff objects to append to.
+   * @return Number of characters inserted and deleted, or -1 if over bound.
+   */
+ private:
+  int diff_boundedCompute(const std::wstring &text1, const std::wstring &text2, int maxEdits, std::deque<Diff> &diffs) const;
 
   /**
    * Given the location of the 'middle snake', split the diff in two parts
@@ -244,7 +827,7 @@ class diff_match_patch {
    * @return LinkedList of Diff objects.
    */
  private:
-  std::deque<Diff> diff_bisectSplit(const std::wstring &text1, const std::wstring &text2, int x, int y, clock_t deadline);
+  std::deque<Diff> diff_bisectSplit(const std::wstring &text1, const std::wstring &text2, int x, int y, clock_t deadline) const;
 
   /**
    * Split two texts into a list of strings.  Reduce the texts to a string of
@@ -256,7 +839,7 @@ class diff_match_patch {
    *     of the List of unique strings is intentionally blank.
    */
  protected:
-  std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> diff_linesToChars(const std::wstring &text1, const std::wstring &text2); // return elems 0 and 1 are std::wstring, elem 2 is std::deque<std::wstring>
+  std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> diff_linesToChars(const std::wstring &text1, const std::wstring &text2) const; // return elems 0 and 1 are std::wstring, elem 2 is std::deque<std::wstring>
 
   /**
    * Split a text into a list of strings.  Reduce the texts to a string of
@@ -268,7 +851,18 @@ class diff_match_patch {
    */
  private:
   std::wstring diff_linesToCharsMunge(const std::wstring &text, std::deque<std::wstring> &lineArray,
-                                 std::map<std::wstring, int> &lineHash);
+                                 std::map<std::wstring, int> &lineHash) const;
+
+  /**
+   * Split two texts into a list of words, with runs of whitespace and
+   * punctuation as words of their own.  Reduce the texts to a string of
+   * hashes where each Unicode character represents one word.
+   * @param text1 First string.
+   * @param text2 Second string.
+   * @return Three element tuple, as for diff_linesToChars.
+   */
+ protected:
+  std::tuple<std::wstring, std::wstring, std::deque<std::wstring>> diff_wordsToChars(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Rehydrate the text in a diff from a string of line hashes to real lines of
@@ -277,7 +871,7 @@ class diff_match_patch {
    * @param lineArray List of unique strings.
    */
  private:
-  void diff_charsToLines(std::deque<Diff> &diffs, const std::deque<std::wstring> &lineArray);
+  void diff_charsToLines(std::deque<Diff> &diffs, const std::deque<std::wstring> &lineArray) const;
 
   /**
    * Determine the common prefix of two strings.
@@ -286,7 +880,7 @@ class diff_match_patch {
    * @return The number of characters common to the start of each string.
    */
  public:
-  int diff_commonPrefix(const std::wstring &text1, const std::wstring &text2);
+  int diff_commonPrefix(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Determine the common suffix of two strings.
@@ -295,7 +889,7 @@ class diff_match_patch {
    * @return The number of characters common to the end of each string.
    */
  public:
-  int diff_commonSuffix(const std::wstring &text1, const std::wstring &text2);
+  int diff_commonSuffix(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Determine if the suffix of one string is the prefix of another.
@@ -305,7 +899,7 @@ class diff_match_patch {
    *     string and the start of the second string.
    */
  protected:
-  int diff_commonOverlap(const std::wstring &text1, const std::wstring &text2);
+  int diff_commonOverlap(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Do the two texts share a substring which is at least half the length of
@@ -318,7 +912,7 @@ class diff_match_patch {
    *     common middle.  Or null if there was no match.
    */
  protected:
-  std::deque<std::wstring> diff_halfMatch(const std::wstring &text1, const std::wstring &text2);
+  std::deque<std::wstring> diff_halfMatch(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Does a substring of shorttext exist within longtext such that the
@@ -331,14 +925,47 @@ class diff_match_patch {
    *     and the common middle.  Or null if there was no match.
    */
  private:
-  std::deque<std::wstring> diff_halfMatchI(const std::wstring &longtext, const std::wstring &shorttext, int i);
+  std::deque<std::wstring> diff_halfMatchI(const std::wstring &longtext, const std::wstring &shorttext, int i) const;
+
+  /**
+   * Split the differences between two texts into hunks without diffing them.
+   * Nothing is diffed up front: the texts are line-diffed from the front a
+   * stretch at a time, as hunks are asked for, cutting the stretches at
+   * lines found once in each.  Hunks are separated by the common lines found
+   * (ignoring equalities no larger than the edits around them, as
+   * diff_cleanupSemantic would).  The detailed diff of each hunk is computed
+   * when the hunk is first accessed.  The list keeps the texts; move them
+   * in to spare copying them.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @return Lazily evaluated list of hunks.
+   */
+ public:
+  DiffHunks diff_hunks(std::wstring text1, std::wstring text2) const;
+
+  /**
+   * Find the differences between a window of text1 and the matching window
+   * of text2.  The window is widened to whole lines and then out to the
+   * nearest lines which occur exactly once in each text; those anchor lines
+   * locate the window in text2.  Only the text between the anchors is
+   * diffed, so apart from one hashing pass over the lines the cost depends
+   * on the size of the window rather than of the texts.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param start1 Start of the window within text1.
+   * @param length1 Length of the window within text1.
+   * @return Patch (without context) locating the diffed region in both
+   *     texts and holding its diffs.
+   */
+ public:
+  Patch diff_window(const std::wstring &text1, const std::wstring &text2, int start1, int length1) const;
 
   /**
    * Reduce the number of edits by eliminating semantically trivial equalities.
    * @param diffs LinkedList of Diff objects.
    */
  public:
-  void diff_cleanupSemantic(std::deque<Diff> &diffs);
+  void diff_cleanupSemantic(std::deque<Diff> &diffs) const;
 
   /**
    * Look for single edits surrounded on both sides by equalities
@@ -347,7 +974,7 @@ class diff_match_patch {
    * @param diffs LinkedList of Diff objects.
    */
  public:
-  void diff_cleanupSemanticLossless(std::deque<Diff> &diffs);
+  void diff_cleanupSemanticLossless(std::deque<Diff> &diffs) const;
 
   /**
    * Given two strings, compute a score representing whether the internal
@@ -358,14 +985,14 @@ class diff_match_patch {
    * @return The score.
    */
  private:
-  int diff_cleanupSemanticScore(const std::wstring &one, const std::wstring &two);
+  int diff_cleanupSemanticScore(const std::wstring &one, const std::wstring &two) const;
 
   /**
    * Reduce the number of edits by eliminating operationally trivial equalities.
    * @param diffs LinkedList of Diff objects.
    */
  public:
-  void diff_cleanupEfficiency(std::deque<Diff> &diffs);
+  void diff_cleanupEfficiency(std::deque<Diff> &diffs) const;
 
   /**
    * Reorder and merge like edit sections.  Merge equalities.
@@ -373,7 +1000,7 @@ class diff_match_patch {
    * @param diffs LinkedList of Diff objects.
    */
  public:
-  void diff_cleanupMerge(std::deque<Diff> &diffs);
+  void diff_cleanupMerge(std::deque<Diff> &diffs) const;
 
   /**
    * loc is a location in text1, compute and return the equivalent location in
@@ -384,7 +1011,7 @@ class diff_match_patch {
    * @return Location within text2.
    */
  public:
-  int diff_xIndex(const std::deque<Diff> &diffs, int loc);
+  int diff_xIndex(const std::deque<Diff> &diffs, int loc) const;
 
   /**
    * Convert a Diff list into a pretty HTML report.
@@ -392,7 +1019,7 @@ class diff_match_patch {
    * @return HTML representation.
    */
  public:
-  std::wstring diff_prettyHtml(const std::deque<Diff> &diffs);
+  std::wstring diff_prettyHtml(const std::deque<Diff> &diffs) const;
 
   /**
    * Compute and return the source text (all equalities and deletions).
@@ -400,7 +1027,7 @@ class diff_match_patch {
    * @return Source text.
    */
  public:
-  std::wstring diff_text1(const std::deque<Diff> &diffs);
+  std::wstring diff_text1(const std::deque<Diff> &diffs) const;
 
   /**
    * Compute and return the destination text (all equalities and insertions).
@@ -408,7 +1035,7 @@ class diff_match_patch {
    * @return Destination text.
    */
  public:
-  std::wstring diff_text2(const std::deque<Diff> &diffs);
+  std::wstring diff_text2(const std::deque<Diff> &diffs) const;
 
   /**
    * Compute the Levenshtein distance; the number of inserted, deleted or
@@ -417,7 +1044,7 @@ class diff_match_patch {
    * @return Number of changes.
    */
  public:
-  int diff_levenshtein(const std::deque<Diff> &diffs);
+  int diff_levenshtein(const std::deque<Diff> &diffs) const;
 
   /**
    * Crush the diff into an encoded string which describes the operations
@@ -428,7 +1055,7 @@ class diff_match_patch {
    * @return Delta text.
    */
  public:
-  std::wstring diff_toDelta(const std::deque<Diff> &diffs);
+  std::wstring diff_toDelta(const std::deque<Diff> &diffs) const;
 
   /**
    * Given the original text1, and an encoded string which describes the
@@ -439,7 +1066,7 @@ class diff_match_patch {
    * @throws std::wstring If invalid input.
    */
  public:
-  std::deque<Diff> diff_fromDelta(const std::wstring &text1, const std::wstring &delta);
+  std::deque<Diff> diff_fromDelta(const std::wstring &text1, const std::wstring &delta) const;
 
 
   //  MATCH FUNCTIONS
@@ -454,7 +1081,74 @@ class diff_match_patch {
    * @return Best match index or -1.
    */
  public:
-  int match_main(const std::wstring &text, const std::wstring &pattern, int loc);
+  int match_main(const std::wstring &text, const std::wstring &pattern, int loc) const;
+
+  /**
+   * Locate the best instance of a compiled pattern in 'text' near 'loc'.
+   * Returns -1 if no match found.
+   * @param text The text to search.
+   * @param pattern The compiled pattern to search for.
+   * @param loc The location to search around.
+   * @return Best match index or -1.
+   */
+ public:
+  int match_main(const std::wstring &text, const MatchPattern &pattern, int loc) const;
+
+  /**
+   * Locate the best instance of 'pattern' in an indexed text near 'loc'.
+   * Only the windows where the pattern could match within Match_Threshold
+   * are searched, with the engine Match_Algorithm picks.
+   * Returns -1 if no match found.
+   * @param index The indexed text to search.
+   * @param pattern The pattern to search for.
+   * @param loc The location to search around.
+   * @return Best match index or -1.
+   */
+ public:
+  int match_main(const MatchIndex &index, const std::wstring &pattern, int loc) const;
+
+  /**
+   * Locate the best instance of a compiled pattern in an indexed text near
+   * 'loc', as above.
+   * @param index The indexed text to search.
+   * @param pattern The compiled pattern to search for.
+   * @param loc The location to search around.
+   * @return Best match index or -1.
+   */
+ public:
+  int match_main(const MatchIndex &index, const MatchPattern &pattern, int loc) const;
+
+  /**
+   * Locate the best instance of each of several patterns in 'text', each
+   * near its own location, as match_main would.  Pieces of all the patterns
+   * are looked for in a single pass over the text, and each pattern is then
+   * searched for only around where its pieces occur, with the engine
+   * Match_Algorithm picks.
+   * @param text The text to search.
+   * @param patterns The patterns to search for.
+   * @param locs The location to search around for each pattern.
+   * @return Best match index or -1 for each pattern.
+   */
+ public:
+  std::vector<int> match_many(const std::wstring &text, const std::vector<std::wstring> &patterns,
+                              const std::vector<int> &locs) const;
+
+  /**
+   * Find the k best places for 'pattern' in 'text' near 'loc', in one pass.
+   * Matches which overlap count once, as the best of them.  Scored as
+   * match_main scores them, within Match_Threshold.  The pass is
+   * match_myers', so the best candidate is where match_myers finds the
+   * pattern; with Match_Algorithm at Bitap, match_main may now and then
+   * settle on another place.
+   * @param text The text to search.
+   * @param pattern The pattern to search for.
+   * @param loc The location to search around.
+   * @param k Most candidates wanted.
+   * @return Up to k candidates, best first.
+   */
+ public:
+  std::vector<MatchCandidate> match_candidates(const std::wstring &text,
+                                               const std::wstring &pattern, int loc, int k) const;
 
   /**
    * Locate the best instance of 'pattern' in 'text' near 'loc' using the
@@ -465,7 +1159,86 @@ class diff_match_patch {
    * @return Best match index or -1.
    */
  protected:
-  int match_bitap(const std::wstring &text, const std::wstring &pattern, int loc);
+  int match_bitap(const std::wstring &text, const std::wstring &pattern, int loc) const;
+  int match_bitap(const std::wstring &text, const MatchPattern &pattern, int loc) const;
+
+  /**
+   * Locate the best instance of 'pattern' in 'text' near 'loc' using Myers'
+   * bit-vector algorithm, which finds the fewest errors a match needs at
+   * every location in a single pass.  Scored as match_bitap.
+   * Returns -1 if no match found.
+   * @param text The text to search.
+   * @param pattern The pattern to search for.
+   * @param loc The location to search around.
+   * @return Best match index or -1.
+   */
+ protected:
+  int match_myers(const std::wstring &text, const std::wstring &pattern, int loc) const;
+  int match_myers(const std::wstring &text, const MatchPattern &pattern, int loc) const;
+
+  /**
+   * Score the locations in a span of text, keeping the best within the
+   * threshold.  The text is read backwards from 'end', so a match is only
+   * seen in full if it ends by then.
+   * @param text The text to search.
+   * @param pattern The compiled pattern to search for.
+   * @param loc The location to search around.
+   * @param first First location to score.
+   * @param end End of the text to read.
+   * @param score_threshold Highest score allowed; lowered on each match.
+   * @param best_loc Best match so far; updated on each match.
+   * @param candidates If given, receives every location within the
+   *     threshold instead, and the threshold and best match are left be.
+   */
+ private:
+  void match_myersScan(const std::wstring &text, const MatchPattern &pattern,
+                       int loc, int first, int end,
+                       double &score_threshold, int &best_loc,
+                       std::vector<MatchCandidate> *candidates = nullptr) const;
+
+  /**
+   * Run Bitap over some spans of text, keeping the best match within the
+   * threshold.  Each error level is worked through the spans from the last
+   * back, over no more of them than match_bitap's window for the level.
+   * @param text The text to search.
+   * @param pattern The compiled pattern to search for.
+   * @param loc The location to search around.
+   * @param spans First location to score and end of the text to read, for
+   *     each span, in ascending order.
+   * @param score_threshold Highest score allowed; lowered on each match.
+   * @param best_loc Best match so far; updated on each match.
+   */
+ private:
+  void match_bitapScan(const std::wstring &text, const MatchPattern &pattern,
+                       int loc, const std::vector<std::pair<int, int>> &spans,
+                       double &score_threshold, int &best_loc) const;
+
+  /**
+   * Search some spans of text with the engine Match_Algorithm picks, keeping
+   * the best match within the threshold.
+   * @param text The text to search.
+   * @param pattern The compiled pattern to search for.
+   * @param loc The location to search around.
+   * @param spans First location to score and end of the text to read, for
+   *     each span, in ascending order.
+   * @param score_threshold Highest score allowed; lowered on each match.
+   * @param best_loc Best match so far; updated on each match.
+   */
+ private:
+  void match_scan(const std::wstring &text, const MatchPattern &pattern,
+                  int loc, const std::vector<std::pair<int, int>> &spans,
+                  double &score_threshold, int &best_loc) const;
+
+  /**
+   * Score of the best exact match around loc, if better than Match_Threshold.
+   * @param text The text to search.
+   * @param pattern The pattern to search for.
+   * @param loc The location to search around.
+   * @return The score to beat.
+   */
+ private:
+  double match_exactThreshold(const std::wstring &text, const std::wstring &pattern,
+                              int loc) const;
 
   /**
    * Compute and return the score for a match with e errors and x location.
@@ -476,7 +1249,21 @@ class diff_match_patch {
    * @return Overall score for match (0.0 = good, 1.0 = bad).
    */
  private:
-  double match_bitapScore(int e, int x, int loc, const std::wstring &pattern);
+  double match_bitapScore(int e, int x, int loc, const std::wstring &pattern) const;
+  double match_bitapScore(int e, int x, int loc, const MatchPattern &pattern) const;
+
+  /**
+   * Find how far from loc a match with e errors may be and still score
+   * within the threshold.
+   * @param e Number of errors in match.
+   * @param loc Expected location of match.
+   * @param pattern Pattern being sought.
+   * @param score_threshold Highest score allowed.
+   * @param bin_max Furthest distance worth considering.
+   * @return Largest distance up to bin_max within the threshold, or 0.
+   */
+ private:
+  int match_bitapReach(int e, int loc, const std::wstring &pattern, double score_threshold, int bin_max) const;
 
   /**
    * Initialise the alphabet for the Bitap algorithm.
@@ -484,7 +1271,7 @@ class diff_match_patch {
    * @return Hash of character locations.
    */
  protected:
-  std::map<wchar_t, int> match_alphabet(const std::wstring &pattern);
+  std::map<wchar_t, int> match_alphabet(const std::wstring &pattern) const;
 
 
  //  PATCH FUNCTIONS
@@ -497,7 +1284,7 @@ class diff_match_patch {
    * @param text Source text.
    */
  protected:
-  void patch_addContext(Patch &patch, const std::wstring &text);
+  void patch_addContext(Patch &patch, const std::wstring &text) const;
 
   /**
    * Compute a list of patches to turn text1 into text2.
@@ -507,7 +1294,7 @@ class diff_match_patch {
    * @return LinkedList of Patch objects.
    */
  public:
-  std::deque<Patch> patch_make(const std::wstring &text1, const std::wstring &text2);
+  std::deque<Patch> patch_make(const std::wstring &text1, const std::wstring &text2) const;
 
   /**
    * Compute a list of patches to turn text1 into text2.
@@ -516,7 +1303,7 @@ class diff_match_patch {
    * @return LinkedList of Patch objects.
    */
  public:
-  std::deque<Patch> patch_make(const std::deque<Diff> &diffs);
+  std::deque<Patch> patch_make(const std::deque<Diff> &diffs) const;
 
   /**
    * Compute a list of patches to turn text1 into text2.
@@ -528,7 +1315,7 @@ class diff_match_patch {
    * @deprecated Prefer patch_make(const std::wstring &text1, const std::deque<Diff> &diffs).
    */
  public:
-  std::deque<Patch> patch_make(const std::wstring &text1, const std::wstring &text2, const std::deque<Diff> &diffs);
+  std::deque<Patch> patch_make(const std::wstring &text1, const std::wstring &text2, const std::deque<Diff> &diffs) const;
 
   /**
    * Compute a list of patches to turn text1 into text2.
@@ -538,7 +1325,17 @@ class diff_match_patch {
    * @return LinkedList of Patch objects.
    */
  public:
-  std::deque<Patch> patch_make(const std::wstring &text1, const std::deque<Diff> &diffs);
+  std::deque<Patch> patch_make(const std::wstring &text1, const std::deque<Diff> &diffs) const;
+
+  /**
+   * Compute patches for many pairs of texts at once, spread over a number of
+   * worker threads as in diff_batch.
+   * @param pairs Old and new texts.
+   * @param threads Number of threads to use, or 0 for one per hardware thread.
+   * @return One LinkedList of Patch objects per pair, in input order.
+   */
+ public:
+  std::vector<std::deque<Patch>> patch_batch(const std::vector<std::pair<std::wstring, std::wstring>> &pairs, int threads = 0) const;
 
   /**
    * Given an array of patches, return another array that is identical.
@@ -546,7 +1343,7 @@ class diff_match_patch {
    * @return Array of patch objects.
    */
  public:
-  std::deque<Patch> patch_deepCopy(std::deque<Patch> &patches);
+  std::deque<Patch> patch_deepCopy(const std::deque<Patch> &patches) const;
 
   /**
    * Merge a set of patches onto the text.  Return a patched text, as well
@@ -557,7 +1354,7 @@ class diff_match_patch {
    *      boolean values.
    */
  public:
-  std::pair<std::wstring,std::deque<bool> > patch_apply(std::deque<Patch> &patches, const std::wstring &text);
+  std::pair<std::wstring,std::deque<bool> > patch_apply(const std::deque<Patch> &patches, const std::wstring &text) const;
 
   /**
    * Add some padding on text start and end so that edges can match something.
@@ -566,7 +1363,7 @@ class diff_match_patch {
    * @return The padding string added to each side.
    */
  public:
-  std::wstring patch_addPadding(std::deque<Patch> &patches);
+  std::wstring patch_addPadding(std::deque<Patch> &patches) const;
 
   /**
    * Look through the patches and break up any which are longer than the
@@ -575,7 +1372,7 @@ class diff_match_patch {
    * @param patches LinkedList of Patch objects.
    */
  public:
-  void patch_splitMax(std::deque<Patch> &patches);
+  void patch_splitMax(std::deque<Patch> &patches) const;
 
   /**
    * Take a list of patches and return a textual representation.
@@ -583,7 +1380,7 @@ class diff_match_patch {
    * @return Text representation of patches.
    */
  public:
-  std::wstring patch_toText(const std::deque<Patch> &patches);
+  std::wstring patch_toText(const std::deque<Patch> &patches) const;
 
   /**
    * Parse a textual representation of patches and return a List of Patch
@@ -593,5 +1390,243 @@ class diff_match_patch {
    * @throws std::wstring If invalid input.
    */
  public:
-  std::deque<Patch> patch_fromText(const std::wstring &textline);
+  std::deque<Patch> patch_fromText(const std::wstring &textline) const;
+};
+
+
+/**
+ * Lazily evaluated list of the hunks between two texts.
+ * Each hunk is a Patch without context: start1/length1 and start2/length2
+ * locate the changed region in each text and diffs holds its detailed diff,
+ * which is only computed when the hunk is first accessed.  The texts are
+ * split into hunks from the front, only as far as has been asked for, so
+ * the first hunks of two large texts come without the rest being diffed.
+ */
+class DiffHunks {
+ public:
+  /**
+   * Constructor.  Use diff_match_patch::diff_hunks instead.
+   * @param dmp Settings to diff each hunk with.
+   * @param text1 Old string.
+   * @param text2 New string.
+   */
+  DiffHunks(const diff_match_patch &dmp, std::wstring text1, std::wstring text2);
+
+  /**
+   * Split the texts into hunks to the end, without diffing the hunks.
+   * @return Number of hunks.
+   */
+  int size();
+
+  /**
+   * Whether there is a hunk at an index, splitting only as far as needed to
+   * tell.  Walk the hunks with "for (int i = 0; hunks.has(i); i++)" to avoid
+   * splitting the texts to the end up front.
+   * @param index Index of the hunk.
+   * @return True if the hunk exists.
+   */
+  bool has(int index);
+
+  /**
+   * Locate the first hunk which contains or follows a location in text1,
+   * splitting only as far as that location.
+   * @param loc Location within text1.
+   * @return Index of the hunk or -1 if no hunk ends at or after loc.
+   */
+  int find(int loc);
+
+  /**
+   * Fetch a hunk, computing its diff on first access.
+   * @param index Index of the hunk, which must exist (see has).
+   * @return The hunk.
+   */
+  const Patch &hunk(int index);
+
+ private:
+  friend class diff_match_patch_test;
+
+  /**
+   * Split off the next hunk.
+   * @return False if there are no more hunks.
+   */
+  bool split();
+
+  /**
+   * Line-diff the next stretch of the texts: the lines they have in common,
+   * then the lines up to the nearest line found once in each (within
+   * windows which double until one is found, or the texts end).
+   * @return False if the texts have been pulled to the end.
+   */
+  bool pull();
+
+  diff_match_patch dmp;
+  std::wstring text1;
+  std::wstring text2;
+  std::deque<Patch> hunks;
+  std::vector<bool> computed;
+  // Line-level diffs pulled but not yet split, as operations and lengths in
+  // characters; and how far into each text they reach.
+  std::deque<std::pair<Diff::Operation, int>> lineDiffs;
+  int pulled1;
+  int pulled2;
+  // How far into each text the splitting has got, the hunk it is in the
+  // middle of, and the size of that hunk's last run of edits.
+  int pos1;
+  int pos2;
+  bool open;
+  Patch pending;
+  int insertions;
+  int deletions;
+};
+
+
+/**
+ * A diff between two texts which is kept up to date as either text is
+ * edited.  Each edit only rediffs the region between the nearest
+ * equalities on either side of it, so its cost depends on the size of the
+ * neighbourhood of the edit rather than on the size of the texts.
+ */
+class IncrementalDiff {
+ public:
+  /**
+   * Constructor.  Diffs the two texts in full.
+   * @param dmp Settings to diff with.
+   * @param text1 Old string.
+   * @param text2 New string.
+   */
+  IncrementalDiff(const diff_match_patch &dmp, const std::wstring &text1,
+                  const std::wstring &text2);
+
+  /**
+   * Replace part of text1 and update the diff.
+   * Use an empty text to delete and a zero length to insert.
+   * @param offset Start of the replaced range within text1.
+   * @param length Length of the replaced range.
+   * @param text Replacement text.
+   * @throws std::wstring If the range is outside text1.
+   */
+  void replace1(int offset, int length, const std::wstring &text);
+
+  /**
+   * Replace part of text2 and update the diff.
+   * Use an empty text to delete and a zero length to insert.
+   * @param offset Start of the replaced range within text2.
+   * @param length Length of the replaced range.
+   * @param text Replacement text.
+   * @throws std::wstring If the range is outside text2.
+   */
+  void replace2(int offset, int length, const std::wstring &text);
+
+  const std::wstring &text1() const;
+  const std::wstring &text2() const;
+  const std::deque<Diff> &diffs() const;
+
+ private:
+  // Characters of the surrounding equalities rediffed along with an edit.
+  static const int Margin = 8;
+
+  diff_match_patch dmp;
+  std::wstring texts[2];
+  std::deque<Diff> diffList;
+  // starts[0][i] and starts[1][i] are the offsets of diffList[i] within
+  // text1 and text2; both have one extra entry for the end of the text.
+  std::vector<int> starts[2];
+
+  void replace(int side, int offset, int length, const std::wstring &text);
+  void reindex(int from);
+};
+
+
+/**
+ * Opt-in cache of diff and patch results, for services which see the same
+ * pair of texts again and again.  Results are keyed by a 128-bit hash of
+ * the texts and of the settings which affect the result, and the least
+ * recently used ones are evicted once the cache outgrows its byte budget.
+ * All methods may be called concurrently; results are computed outside the
+ * lock so that misses don't hold up other lookups, and hits share the cached
+ * result, copying it only once the lock is let go.  A diff which ran into
+ * Diff_Timeout is not cached, since a later call could do better.
+ */
+class DiffCache {
+ public:
+  /**
+   * Constructor.
+   * @param byteBudget Approximate memory the cached results may use.
+   */
+  explicit DiffCache(size_t byteBudget);
+
+  /**
+   * Cached diff_match_patch::diff_main.
+   * @param dmp Settings to diff with.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag.
+   * @return Linked List of Diff objects.
+   */
+  std::deque<Diff> diff_main(const diff_match_patch &dmp, const std::wstring &text1,
+                             const std::wstring &text2, bool checklines = true);
+
+  /**
+   * Cached diff_match_patch::patch_make.
+   * @param dmp Settings to diff with.
+   * @param text1 Old text.
+   * @param text2 New text.
+   * @return LinkedList of Patch objects.
+   */
+  std::deque<Patch> patch_make(const diff_match_patch &dmp, const std::wstring &text1,
+                               const std::wstring &text2);
+
+  /**
+   * Cached diff_match_patch::diff_toDelta of the diff between two texts.
+   * @param dmp Settings to diff with.
+   * @param text1 Old string to be diffed.
+   * @param text2 New string to be diffed.
+   * @param checklines Speedup flag.
+   * @return Delta text.
+   */
+  std::wstring diff_toDelta(const diff_match_patch &dmp, const std::wstring &text1,
+                            const std::wstring &text2, bool checklines = true);
+
+  size_t hits() const;
+  size_t misses() const;
+  // Approximate memory used by the cached results.
+  size_t bytes() const;
+  void clear();
+
+ private:
+  friend class diff_match_patch_test;
+
+  struct Key {
+    uint64_t lo;
+    uint64_t hi;
+    bool operator==(const Key &k) const { return lo == k.lo && hi == k.hi; }
+  };
+  struct KeyHash {
+    size_t operator()(const Key &k) const { return static_cast<size_t>(k.lo); }
+  };
+  struct Entry {
+    Key key;
+    size_t bytes;
+    // Only the member matching the kind of the key is filled in.
+    std::deque<Diff> diffs;
+    std::deque<Patch> patches;
+    std::wstring delta;
+  };
+  enum class Kind {
+    Diff, Patch, Delta
+  };
+
+  const size_t byteBudget;
+  mutable std::mutex mutex;
+  std::list<std::shared_ptr<const Entry>> entries;  // Most recently used first.
+  std::unordered_map<Key, std::list<std::shared_ptr<const Entry>>::iterator, KeyHash> index;
+  size_t usedBytes;
+  std::atomic<size_t> hitCount;
+  std::atomic<size_t> missCount;
+
+  static Key makeKey(Kind kind, const diff_match_patch &dmp, bool checklines,
+                     const std::wstring &text1, const std::wstring &text2);
+  std::shared_ptr<const Entry> lookup(const Key &key);
+  void store(Entry &&entry, const diff_match_patch &dmp,
+             std::chrono::steady_clock::time_point start);
 };
@@ -0,0 +1,389 @@
+/*
+ * Diff Match and Patch -- Benchmarks
+ * Copyright 2018 The diff-match-patch Authors.
+ * https://github.com/google/diff-match-patch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <thread>
+#include "dmp.h"
+
+typedef std::vector<std::pair<std::wstring, std::wstring>> TextPairs;
+
+// Deterministic pseudo-random numbers, so that runs are comparable.
+static unsigned int seed = 1;
+static unsigned int nextRandom()
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+// A source-file-like text of the given number of lines.
+static std::wstring makeFile(int lines)
+{
+  std::wstring text;
+  for (int i = 0; i < lines; i++) {
+    switch (nextRandom() % 4) {
+      case 0:
+        text += L"}\n";
+        break;
+      case 1:
+        text += L"\n";
+        break;
+      default:
+        text += L"  value" + std::to_wstring(nextRandom() % 500) + L" = compute("
+            + std::to_wstring(nextRandom()) + L");\n";
+    }
+  }
+  return text;
+}
+
+// The same text with a few lines changed, inserted and deleted.
+static std::wstring editFile(const std::wstring &text, int edits)
+{
+  std::wstring result = text;
+  for (int i = 0; i < edits && !result.empty(); i++) {
+    size_t start = result.rfind(L'\n', nextRandom() % result.length());
+    start = start == std::wstring::npos ? 0 : start + 1;
+    size_t end = result.find(L'\n', start);
+    end = end == std::wstring::npos ? result.length() : end + 1;
+    switch (nextRandom() % 3) {
+      case 0:
+        result.erase(start, end - start);
+        break;
+      case 1:
+        result.insert(start, L"  inserted(" + std::to_wstring(nextRandom()) + L");\n");
+        break;
+      default:
+        result.replace(start, end - start, L"  changed = " + std::to_wstring(nextRandom()) + L";\n");
+    }
+  }
+  return result;
+}
+
+// Many small file pairs of mixed sizes, as in a large commit.
+static TextPairs makeCommit(int files)
+{
+  TextPairs pairs;
+  for (int i = 0; i < files; i++) {
+    std::wstring text1 = makeFile(20 + nextRandom() % (i % 50 == 0 ? 2000 : 200));
+    pairs.push_back(std::make_pair(text1, editFile(text1, 1 + nextRandom() % 10)));
+  }
+  return pairs;
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchBatch()
+{
+  diff_match_patch dmp;
+  dmp.Diff_Timeout = 0;
+  const TextPairs pairs = makeCommit(2000);
+  const int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  std::printf("diff_batch, %zu file pairs\n", pairs.size());
+  std::vector<int> threadCounts;
+  for (int threads = 1; threads < maxThreads; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  double single = 0;
+  for (int threads : threadCounts) {
+    auto start = std::chrono::steady_clock::now();
+    dmp.diff_batch(pairs, threads);
+    const double ms = elapsed(start);
+    if (threads == 1) {
+      single = ms;
+    }
+    std::printf("  %3d threads: %9.1f ms  speedup %.2fx\n", threads, ms, single / ms);
+  }
+}
+
+// Number of separate runs of changes in a diff.
+static int countHunks(const std::deque<Diff> &diffs)
+{
+  int hunks = 0;
+  bool inHunk = false;
+  for (const Diff &aDiff : diffs) {
+    if (aDiff.operation == Diff::Operation::Equal) {
+      inHunk = false;
+    } else if (!inHunk) {
+      inHunk = true;
+      hunks++;
+    }
+  }
+  return hunks;
+}
+
+static void benchAlgorithms()
+{
+  TextPairs pairs;
+  for (int i = 0; i < 20; i++) {
+    std::wstring text1 = makeFile(3000);
+    pairs.push_back(std::make_pair(text1, editFile(text1, 100)));
+  }
+
+  std::printf("Line diff algorithms, %zu source-like file pairs\n", pairs.size());
+  const char *names[] = {"Myers", "Histogram"};
+  const diff_match_patch::DiffAlgorithm algorithms[] = {
+      diff_match_patch::DiffAlgorithm::Myers,
+      diff_match_patch::DiffAlgorithm::Histogram};
+  for (int a = 0; a < 2; a++) {
+    diff_match_patch dmp;
+    dmp.Diff_Timeout = 0;
+    dmp.Diff_Algorithm = algorithms[a];
+    long edits = 0;
+    long hunks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &pair : pairs) {
+      std::deque<Diff> diffs = dmp.diff_main(pair.first, pair.second);
+      edits += dmp.diff_levenshtein(diffs);
+      hunks += countHunks(diffs);
+    }
+    std::printf("  %-10s %9.1f ms  %8ld edits  %6ld hunks\n", names[a],
+                elapsed(start), edits, hunks);
+  }
+}
+
+// Random prose-like text of the given length.
+static std::wstring makeText(int length)
+{
+  std::wstring text;
+  while (static_cast<int>(text.length()) < length) {
+    text += nextRandom() % 6 == 0 ? L' ' : static_cast<wchar_t>(L'a' + nextRandom() % 26);
+  }
+  return text;
+}
+
+// The same text with single characters changed every so often.
+static std::wstring mutateText(const std::wstring &text, int every)
+{
+  std::wstring result = text;
+  for (size_t i = nextRandom() % every; i < result.length(); i += 1 + nextRandom() % every) {
+    result[i] = static_cast<wchar_t>(L'a' + nextRandom() % 26);
+  }
+  return result;
+}
+
+// Milliseconds per diff of the pair, timed over a few repetitions.
+static double timeDiff(const diff_match_patch &dmp, const std::wstring &text1,
+                       const std::wstring &text2)
+{
+  const int repeats = 3;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    dmp.diff_main(text1, text2, false);
+  }
+  return elapsed(start) / repeats;
+}
+
+// Times the engines against each other to suggest thresholds for the planner
+// on this machine.
+static void calibrate()
+{
+  diff_match_patch dmp;
+  dmp.Diff_Timeout = 0;
+  dmp.Diff_ONPRatio = 1e9f;
+
+  std::printf("Planner calibration: bit-parallel vs bisect\n");
+  int64_t cellLimit = 0;
+  for (int length = 500; length <= 8000; length *= 2) {
+    const std::wstring text1 = makeText(length);
+    const std::wstring text2 = mutateText(text1, 20);
+    dmp.Diff_BitParallelCells = std::numeric_limits<int64_t>::max();
+    const double bitParallel = timeDiff(dmp, text1, text2);
+    dmp.Diff_BitParallelCells = 0;
+    const double bisect = timeDiff(dmp, text1, text2);
+    const int64_t cells = static_cast<int64_t>(length) * length;
+    if (bitParallel <= bisect) {
+      cellLimit = cells;
+    }
+    std::printf("  %6d chars: %9.2f ms  %9.2f ms\n", length, bitParallel, bisect);
+  }
+  std::printf("  suggested Diff_BitParallelCells = %lld\n", static_cast<long long>(cellLimit));
+
+  std::printf("Planner calibration: O(NP) vs bisect\n");
+  dmp.Diff_BitParallelCells = 0;
+  float ratioLimit = 0;
+  const std::wstring shorttext = makeText(2000);
+  for (int ratio = 16; ratio >= 1; ratio /= 2) {
+    std::wstring longtext = mutateText(shorttext, 20);
+    longtext += makeText(2000 * (ratio - 1));
+    dmp.Diff_ONPRatio = 1;
+    const double onp = timeDiff(dmp, shorttext, longtext);
+    dmp.Diff_ONPRatio = 1e9f;
+    const double bisect = timeDiff(dmp, shorttext, longtext);
+    if (onp <= bisect) {
+      ratioLimit = ratio;
+    }
+    std::printf("  ratio %3d: %9.2f ms  %9.2f ms\n", ratio, onp, bisect);
+  }
+  std::printf("  suggested Diff_ONPRatio = %g\n", ratioLimit);
+}
+
+// The same text with lines swapped in pairs: no character is added or
+// removed, so no diff comes near the race's lower bound.
+static std::wstring swapLines(const std::wstring &text, int swaps)
+{
+  std::vector<std::wstring> lines;
+  size_t start = 0;
+  while (start < text.length()) {
+    size_t end = text.find(L'\n', start);
+    end = end == std::wstring::npos ? text.length() : end + 1;
+    lines.push_back(text.substr(start, end - start));
+    start = end;
+  }
+  for (int i = 0; i < swaps && !lines.empty(); i++) {
+    std::swap(lines[nextRandom() % lines.size()], lines[nextRandom() % lines.size()]);
+  }
+  std::wstring result;
+  for (const std::wstring &line : lines) {
+    result += line;
+  }
+  return result;
+}
+
+// Median and 99th percentile time per diff, with and without racing.
+static void benchRace()
+{
+  TextPairs mixed;
+  for (int i = 0; i < 200; i++) {
+    if (i % 2 == 0) {
+      std::wstring text1 = makeFile(200 + nextRandom() % 800);
+      mixed.push_back(std::make_pair(text1, editFile(text1, 1 + nextRandom() % 40)));
+    } else {
+      std::wstring text1 = makeText(2000 + nextRandom() % 6000);
+      mixed.push_back(std::make_pair(text1, mutateText(text1, 5 + nextRandom() % 50)));
+    }
+  }
+  TextPairs swapped;
+  for (int lines : {3000, 20000}) {
+    for (int i = 0; i < 5; i++) {
+      std::wstring text1 = makeFile(lines);
+      swapped.push_back(std::make_pair(text1, swapLines(text1, 10)));
+    }
+  }
+
+  for (const TextPairs *pairs : {&mixed, &swapped}) {
+    std::printf("diff_main latency, %zu %s pairs\n", pairs->size(),
+                pairs == &mixed ? "mixed" : "line-swapped");
+    for (bool race : {false, true}) {
+      diff_match_patch dmp;
+      dmp.Diff_Timeout = 0;
+      dmp.Diff_Race = race;
+      std::vector<double> times;
+      for (const auto &pair : *pairs) {
+        auto start = std::chrono::steady_clock::now();
+        dmp.diff_main(pair.first, pair.second);
+        times.push_back(elapsed(start));
+      }
+      std::sort(times.begin(), times.end());
+      std::printf("  %-8s median %8.2f ms  p99 %8.2f ms\n", race ? "race" : "single",
+                  times[times.size() / 2], times[times.size() * 99 / 100]);
+    }
+  }
+}
+
+// Fuzzy matching, alone and as patch_apply uses it.
+static void benchMatch()
+{
+  diff_match_patch dmp;
+  dmp.Diff_Timeout = 0;
+  const std::wstring text = makeFile(3000);
+  std::vector<std::pair<std::wstring, int>> patterns;
+  for (int i = 0; i < 500; i++) {
+    const int loc = nextRandom() % (text.length() - dmp.Match_MaxBits);
+    patterns.push_back(std::make_pair(
+        mutateText(text.substr(loc, dmp.Match_MaxBits), 8),
+        loc + static_cast<int>(nextRandom() % 200) - 100));
+  }
+  std::printf("Fuzzy matching, %zu patterns in %zu characters\n", patterns.size(), text.length());
+  const char *names[] = {"Bitap", "Myers"};
+  const diff_match_patch::MatchAlgorithm algorithms[] = {
+      diff_match_patch::MatchAlgorithm::Bitap,
+      diff_match_patch::MatchAlgorithm::Myers};
+  for (int a = 0; a < 2; a++) {
+    dmp.Match_Algorithm = algorithms[a];
+    auto start = std::chrono::steady_clock::now();
+    int found = 0;
+    for (const auto &pattern : patterns) {
+      found += dmp.match_main(text, pattern.first, pattern.second) != -1;
+    }
+    std::printf("  match_main %-6s %9.1f ms  %d found\n", names[a], elapsed(start), found);
+  }
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Bitap;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<MatchPattern> compiled;
+  for (const auto &pattern : patterns) {
+    compiled.emplace_back(pattern.first);
+  }
+  const double compiling = elapsed(start);
+  start = std::chrono::steady_clock::now();
+  int matched = 0;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    matched += dmp.match_main(text, compiled[i], patterns[i].second) != -1;
+  }
+  std::printf("  match_main Compiled %7.1f ms  %d found, %.1f ms to compile\n", elapsed(start),
+              matched, compiling);
+  start = std::chrono::steady_clock::now();
+  const MatchIndex index(text, 4);
+  const double indexing = elapsed(start);
+  int found = 0;
+  for (const auto &pattern : patterns) {
+    found += dmp.match_main(index, pattern.first, pattern.second) != -1;
+  }
+  std::printf("  match_main Index  %9.1f ms  %d found, %.1f ms to index\n", elapsed(start),
+              found, indexing);
+  start = std::chrono::steady_clock::now();
+  std::vector<std::wstring> texts;
+  std::vector<int> locs;
+  for (const auto &pattern : patterns) {
+    texts.push_back(pattern.first);
+    locs.push_back(pattern.second);
+  }
+  const std::vector<int> many = dmp.match_many(text, texts, locs);
+  std::printf("  match_many        %9.1f ms  %ld found\n", elapsed(start),
+              static_cast<long>(many.size() - std::count(many.begin(), many.end(), -1)));
+
+  const std::wstring edited = editFile(text, 200);
+  const std::deque<Patch> patches = dmp.patch_make(text, edited);
+  const std::wstring drifted = editFile(text, 200);
+  for (int gram : {0, 4}) {
+    dmp.Patch_IndexGram = gram;
+    start = std::chrono::steady_clock::now();
+    const auto result = dmp.patch_apply(patches, drifted);
+    const int applied = std::count(result.second.begin(), result.second.end(), true);
+    std::printf("  patch_apply %-5s %9.1f ms  %d of %zu applied\n", gram == 0 ? "" : "Index",
+                elapsed(start), applied, result.second.size());
+  }
+}
+
+int main()
+{
+  benchBatch();
+  benchAlgorithms();
+  calibrate();
+  benchRace();
+  benchMatch();
+  return 0;
+}
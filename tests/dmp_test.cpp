@@ -17,6 +17,7 @@
  */
 
 #include <chrono>
+#include <thread>
 #include "dmp.h"
 #include "dmp_test.h"
 
@@ -94,9 +95,30 @@ void diff_match_patch_test::run_all_tests() {
     testDiffLevenshtein();
     testDiffBisect();
     testDiffMain();
+    testDiffStream();
+    testDiffHunks();
+    testDiffWindow();
+    testDiffIncremental();
+    testDiffCache();
+    testDiffBatch();
+    testOptions();
+    testDiffHistogram();
+    testDiffAnchored();
+    testDiffBitParallel();
+    testDiffOnp();
+    testDiffPlan();
+    testDiffRace();
+    testDiffBounded();
+    testDiffSimilarWithin();
+    testDiffStats();
 
     testMatchAlphabet();
     testMatchBitap();
+    testMatchMyers();
+    testMatchIndex();
+    testMatchMany();
+    testMatchCandidates();
+    testMatchPattern();
     testMatchMain();
 
     testPatchObj();
@@ -588,17 +610,18 @@ void diff_match_patch_test::testDiffMain() {
     a = a + a;
     b = b + b;
   }
-  clock_t startTime = clock();
+  // The timeout is wall-clock time.
+  std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
   dmp.diff_main(a, b);
-  clock_t endTime = clock();
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
   // Test that we took at least the timeout period.
-  assertTrue(L"diff_main: Timeout min.", dmp.Diff_Timeout * CLOCKS_PER_SEC <= endTime - startTime);
+  assertTrue(L"diff_main: Timeout min.", dmp.Diff_Timeout <= elapsed);
   // Test that we didn't take forever (be forgiving).
   // Theoretically this test could fail very occasionally if the
   // OS task swaps or locks up for a second at the wrong moment.
   // Java seems to overrun by ~80% (compared with 10% for other languages).
   // Therefore use an upper limit of 0.5s instead of 0.2s.
-  assertTrue(L"diff_main: Timeout max.", dmp.Diff_Timeout * CLOCKS_PER_SEC * 2 > endTime - startTime);
+  assertTrue(L"diff_main: Timeout max.", dmp.Diff_Timeout * 2 > elapsed);
   dmp.Diff_Timeout = 0;
 
   // Test the linemode speedup.
@@ -618,6 +641,749 @@ void diff_match_patch_test::testDiffMain() {
   assertEquals(L"diff_main: Overlap line-mode.", texts_textmode, texts_linemode);
 }
 
+void diff_match_patch_test::testDiffStream() {
+  // Collect the streamed diff back into a list.
+  std::deque<Diff> streamed;
+  diff_match_patch::DiffSink sink = [&streamed](Diff::Operation op, const std::wstring &text) {
+    streamed.push_back(Diff(op, text));
+  };
+
+  dmp.diff_main(L"", L"", false, sink);
+  assertEquals(L"diff_main (stream): Null case.", diffList(), streamed);
+
+  streamed.clear();
+  dmp.diff_main(L"abc", L"abc", false, sink);
+  assertEquals(L"diff_main (stream): Equality.", diffList(Diff(Diff::Operation::Equal, L"abc")), streamed);
+
+  dmp.Diff_Timeout = 0;
+  streamed.clear();
+  dmp.diff_main(L"Apples are a fruit.", L"Bananas are also fruit.", false, sink);
+  assertEquals(L"diff_main (stream): Simple case.", dmp.diff_main(L"Apples are a fruit.", L"Bananas are also fruit.", false), streamed);
+
+  streamed.clear();
+  dmp.diff_main(L"ABCDa=bcd=efghijklmnopqrsEFGHIJKLMNOefg", L"a-bcd-efghijklmnopqrs", false, sink);
+  assertEquals(L"diff_main (stream): Overlap.", dmp.diff_main(L"ABCDa=bcd=efghijklmnopqrsEFGHIJKLMNOefg", L"a-bcd-efghijklmnopqrs", false), streamed);
+
+  // Half-match regions are streamed one after the other.
+  dmp.Diff_Timeout = 1;
+  streamed.clear();
+  dmp.diff_main(L"1234567890", L"a345678z", false, sink);
+  assertEquals(L"diff_main (stream): Half-match.", dmp.diff_main(L"1234567890", L"a345678z", false), streamed);
+
+  // Line-mode blocks are streamed one after the other.
+  std::wstring a = L"1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n1234567890\n";
+  std::wstring b = L"abcdefghij\n1234567890\n1234567890\n1234567890\nabcdefghij\n1234567890\n1234567890\n1234567890\nabcdefghij\n1234567890\n1234567890\n1234567890\nabcdefghij\n";
+  streamed.clear();
+  dmp.diff_main(a, b, true, sink);
+  assertEquals(L"diff_main (stream): Line-mode.", dmp.diff_main(a, b, true), streamed);
+  std::deque<std::wstring> texts;
+  texts.push_back(a);
+  texts.push_back(b);
+  assertEquals(L"diff_main (stream): Line-mode texts.", texts, diff_rebuildtexts(streamed));
+  bool coalesced = true;
+  for (size_t i = 1; i < streamed.size(); i++) {
+    coalesced = coalesced && streamed[i - 1].operation != streamed[i].operation;
+  }
+  assertTrue(L"diff_main (stream): Coalesced.", coalesced);
+  dmp.Diff_Timeout = 0;
+}
+
+void diff_match_patch_test::testDiffHunks() {
+  assertEquals(L"diff_hunks: Null case.", 0, dmp.diff_hunks(L"", L"").size());
+
+  assertEquals(L"diff_hunks: Equality.", 0, dmp.diff_hunks(L"abc\ndef\n", L"abc\ndef\n").size());
+
+  std::wstring common;
+  for (int x = 0; x < 10; x++) {
+    common += L"The quick brown fox jumps over the lazy dog.\n";
+  }
+  std::wstring text1 = L"alpha\n" + common + L"beta\n" + common + L"\ngamma\n\ndelta\n" + common;
+  std::wstring text2 = common + L"beta!\n" + common + L"\nGamma\n\nDelta\n" + common + L"omega\n";
+  DiffHunks hunks = dmp.diff_hunks(text1, text2);
+  assertEquals(L"diff_hunks: Count.", 4, hunks.size());
+
+  // The blank line between gamma and delta is absorbed into a single hunk.
+  const Patch &third = hunks.hunk(2);
+  assertEquals(L"diff_hunks: Location.", 6 + 2 * common.length() + 5 + 1, third.start1);
+  assertEquals(L"diff_hunks: Length.", 13, third.length1);
+  assertEquals(L"diff_hunks: Diffs.", diffList(Diff(Diff::Operation::Delete, L"g"), Diff(Diff::Operation::Insert, L"G"), Diff(Diff::Operation::Equal, L"amma\n\n"), Diff(Diff::Operation::Delete, L"d"), Diff(Diff::Operation::Insert, L"D"), Diff(Diff::Operation::Equal, L"elta\n")), third.diffs);
+
+  // Rebuild text2 from text1 and the hunks.
+  std::wstring rebuilt;
+  int pos = 0;
+  for (int x = 0; x < hunks.size(); x++) {
+    const Patch &aHunk = hunks.hunk(x);
+    rebuilt += text1.substr(pos, aHunk.start1 - pos) + dmp.diff_text2(aHunk.diffs);
+    pos = aHunk.start1 + aHunk.length1;
+  }
+  rebuilt += text1.substr(pos);
+  assertEquals(L"diff_hunks: Rebuild.", text2, rebuilt);
+
+  assertEquals(L"diff_hunks: Find first.", 0, hunks.find(0));
+  assertEquals(L"diff_hunks: Find inside.", 2, hunks.find(third.start1 + 3));
+  assertEquals(L"diff_hunks: Find between.", 3, hunks.find(third.start1 + third.length1 + 1));
+  assertEquals(L"diff_hunks: Find past end.", -1, hunks.find(text1.length() + 1));
+
+  // The first hunk of a large file comes without the rest being diffed.
+  text1.clear();
+  text2.clear();
+  for (int x = 0; x < 20000; x++) {
+    const std::wstring line = L"value" + std::to_wstring(x) + L" = f(" + std::to_wstring(x % 7) + L");\n";
+    text1 += line;
+    text2 += x == 10 || x == 19990 ? L"changed();\n" : line;
+  }
+  const int length1 = text1.length();
+  DiffHunks large = dmp.diff_hunks(text1, text2);
+  assertEquals(L"diff_hunks: Large first.", static_cast<int>(text1.find(L"value10 ")), large.hunk(0).start1);
+  assertTrue(L"diff_hunks: Large first is lazy.", large.pulled1 < length1 / 100);
+  const int last = large.find(text1.find(L"value19000 "));
+  assertEquals(L"diff_hunks: Large find.", 1, last);
+  assertEquals(L"diff_hunks: Large last text1.", std::wstring(L"value19990 = f(5);\n"), dmp.diff_text1(large.hunk(last).diffs));
+  assertEquals(L"diff_hunks: Large last text2.", std::wstring(L"changed();\n"), dmp.diff_text2(large.hunk(last).diffs));
+  assertFalse(L"diff_hunks: Large end.", large.has(2));
+  assertEquals(L"diff_hunks: Large size.", 2, large.size());
+}
+
+void diff_match_patch_test::testDiffWindow() {
+  std::wstring text1;
+  std::wstring text2;
+  for (int x = 0; x < 100; x++) {
+    std::wstring line = L"line " + std::to_wstring(x) + L"\n";
+    text1 += line;
+    if (x == 5) {
+      text2 += L"inserted\n";
+    }
+    text2 += (x == 50) ? L"line fifty\n" : line;
+  }
+  std::wstring line50 = L"line 50\n";
+  int start1 = text1.find(line50);
+
+  Patch patch = dmp.diff_window(text1, text2, start1 + 2, 3);
+  assertEquals(L"diff_window: Start1.", text1.find(L"line 50\n"), patch.start1);
+  assertEquals(L"diff_window: Start2.", text2.find(L"line fifty\n"), patch.start2);
+  assertEquals(L"diff_window: Length1.", line50.length(), patch.length1);
+  assertEquals(L"diff_window: Diffs.", diffList(Diff(Diff::Operation::Equal, L"line "), Diff(Diff::Operation::Delete, L"50"), Diff(Diff::Operation::Insert, L"fifty"), Diff(Diff::Operation::Equal, L"\n")), patch.diffs);
+
+  // Repeated lines can't anchor, so the window grows out to unique ones.
+  text1 = L"a\nx\nx\nb\nx\nc\n";
+  text2 = L"a\nx\nb\nx\ny\nc\n";
+  patch = dmp.diff_window(text1, text2, 3, 1);
+  assertEquals(L"diff_window: Grown start1.", 2, patch.start1);
+  assertEquals(L"diff_window: Grown start2.", 2, patch.start2);
+  assertEquals(L"diff_window: Grown diffs.", L"x\nx\n", dmp.diff_text1(patch.diffs));
+  assertEquals(L"diff_window: Grown diffs.", L"x\n", dmp.diff_text2(patch.diffs));
+
+  patch = dmp.diff_window(text1, text2, 8, 1);
+  assertEquals(L"diff_window: Anchored start1.", 8, patch.start1);
+  assertEquals(L"diff_window: Anchored start2.", 6, patch.start2);
+  assertEquals(L"diff_window: Anchored diffs.", L"x\n", dmp.diff_text1(patch.diffs));
+  assertEquals(L"diff_window: Anchored diffs.", L"x\ny\n", dmp.diff_text2(patch.diffs));
+
+  // Without anchors the whole texts are diffed.
+  patch = dmp.diff_window(L"x\nx\n", L"x\n", 0, 1);
+  assertEquals(L"diff_window: No anchors.", 0, patch.start1);
+  assertEquals(L"diff_window: No anchors.", 4, patch.length1);
+  assertEquals(L"diff_window: No anchors.", 2, patch.length2);
+}
+
+void diff_match_patch_test::testDiffIncremental() {
+  IncrementalDiff incremental(dmp, L"The quick brown fox jumps over the lazy dog.", L"The quick brown fox jumps over the lazy dog.");
+  assertEquals(L"IncrementalDiff: Initial.", diffList(Diff(Diff::Operation::Equal, L"The quick brown fox jumps over the lazy dog.")), incremental.diffs());
+
+  // Edit inside an equality.
+  incremental.replace2(16, 3, L"cat");
+  assertEquals(L"IncrementalDiff: Replace.", diffList(Diff(Diff::Operation::Equal, L"The quick brown "), Diff(Diff::Operation::Delete, L"fox"), Diff(Diff::Operation::Insert, L"cat"), Diff(Diff::Operation::Equal, L" jumps over the lazy dog.")), incremental.diffs());
+
+  // Make the edit disappear again.
+  incremental.replace1(16, 3, L"cat");
+  assertEquals(L"IncrementalDiff: Undo.", diffList(Diff(Diff::Operation::Equal, L"The quick brown cat jumps over the lazy dog.")), incremental.diffs());
+
+  // Insert at the very start and delete at the very end.
+  incremental.replace2(0, 0, L">> ");
+  incremental.replace1(incremental.text1().length() - 1, 1, L"");
+  assertEquals(L"IncrementalDiff: Edges.", diffList(Diff(Diff::Operation::Insert, L">> "), Diff(Diff::Operation::Equal, L"The quick brown cat jumps over the lazy dog"), Diff(Diff::Operation::Insert, L".")), incremental.diffs());
+
+  // A run of keystrokes on both sides keeps the diff consistent.
+  std::wstring text1;
+  for (int x = 0; x < 40; x++) {
+    text1 += L"Line " + std::to_wstring(x) + L" of the base document.\n";
+  }
+  IncrementalDiff typing(dmp, text1, text1);
+  unsigned int seed = 1;
+  bool consistent = true;
+  for (int x = 0; x < 200; x++) {
+    seed = seed * 1103515245 + 12345;
+    const int side = (seed >> 16) % 4 == 0 ? 0 : 1;
+    const std::wstring &text = side == 0 ? typing.text1() : typing.text2();
+    const int offset = (seed >> 8) % (text.length() + 1);
+    const int length = std::min<int>((seed >> 4) % 3, text.length() - offset);
+    const std::wstring insertion = (seed >> 20) % 2 ? std::wstring(1, L'a' + (seed >> 24) % 26) : L"";
+    if (side == 0) {
+      typing.replace1(offset, length, insertion);
+    } else {
+      typing.replace2(offset, length, insertion);
+    }
+    consistent = consistent && dmp.diff_text1(typing.diffs()) == typing.text1()
+        && dmp.diff_text2(typing.diffs()) == typing.text2();
+    for (size_t i = 1; i < typing.diffs().size(); i++) {
+      consistent = consistent && typing.diffs()[i - 1].operation != typing.diffs()[i].operation
+          && !typing.diffs()[i].text.empty();
+    }
+  }
+  assertTrue(L"IncrementalDiff: Typing.", consistent);
+
+  try {
+    typing.replace1(typing.text1().length(), 1, L"x");
+    assertFalse(L"IncrementalDiff: Out of range.", true);
+  } catch (std::wstring ex) {
+    // Exception expected.
+  }
+}
+
+void diff_match_patch_test::testDiffCache() {
+  DiffCache cache(1 << 20);
+  std::wstring text1 = L"The quick brown fox jumps over the lazy dog.";
+  std::wstring text2 = L"That quick brown fox jumped over a lazy dog.";
+  assertEquals(L"DiffCache: Miss.", dmp.diff_main(text1, text2), cache.diff_main(dmp, text1, text2));
+  assertEquals(L"DiffCache: Hit.", dmp.diff_main(text1, text2), cache.diff_main(dmp, text1, text2));
+  assertEquals(L"DiffCache: Counters.", 1, cache.hits());
+  assertEquals(L"DiffCache: Counters.", 1, cache.misses());
+
+  // Results of different kinds and settings are kept apart.
+  assertEquals(L"DiffCache: Delta.", dmp.diff_toDelta(dmp.diff_main(text1, text2)), cache.diff_toDelta(dmp, text1, text2));
+  assertEquals(L"DiffCache: Patch.", dmp.patch_toText(dmp.patch_make(text1, text2)), dmp.patch_toText(cache.patch_make(dmp, text1, text2)));
+  dmp.Diff_Timeout = 2;
+  cache.diff_main(dmp, text1, text2);
+  assertEquals(L"DiffCache: Settings.", 4, cache.misses());
+  cache.diff_main(dmp, text2, text1);
+  assertEquals(L"DiffCache: Swapped.", 5, cache.misses());
+
+  // A small budget evicts the least recently used result.
+  DiffCache one(1 << 20);
+  one.diff_main(dmp, text1, text2);
+  DiffCache small(one.bytes() * 3 / 2);
+  small.diff_main(dmp, text1, text2);
+  small.diff_main(dmp, text2, text1);
+  assertTrue(L"DiffCache: Budget.", small.bytes() <= small.byteBudget);
+  small.diff_main(dmp, text1, text2);
+  assertEquals(L"DiffCache: Evicted.", 3, small.misses());
+  small.clear();
+  assertEquals(L"DiffCache: Clear.", 0, small.bytes());
+
+  // A diff cut short by the timeout is not kept.
+  unsigned int seed = 1;
+  text1.clear();
+  text2.clear();
+  for (int x = 0; x < 20000; x++) {
+    seed = seed * 1103515245 + 12345;
+    text1 += static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+    seed = seed * 1103515245 + 12345;
+    text2 += static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+  }
+  dmp.Diff_Timeout = 0.001f;
+  DiffCache timed(1 << 24);
+  timed.diff_main(dmp, text1, text2, false);
+  timed.diff_main(dmp, text1, text2, false);
+  assertEquals(L"DiffCache: Timed out.", 0, timed.hits());
+  assertEquals(L"DiffCache: Timed out bytes.", 0, timed.bytes());
+  dmp.Diff_Timeout = 0;
+}
+
+void diff_match_patch_test::testDiffBatch() {
+  std::vector<std::pair<std::wstring, std::wstring>> pairs;
+  pairs.push_back(std::make_pair(L"", L""));
+  pairs.push_back(std::make_pair(L"abc", L"ab123c"));
+  pairs.push_back(std::make_pair(L"The quick brown fox.", L"The quick red fox."));
+  std::wstring text1, text2;
+  for (int x = 0; x < 200; x++) {
+    text1 += L"Line " + std::to_wstring(x) + L"\n";
+    text2 += L"Line " + std::to_wstring(x % 7 == 0 ? -x : x) + L"\n";
+  }
+  pairs.push_back(std::make_pair(text1, text2));
+  pairs.push_back(std::make_pair(L"12345", L""));
+
+  std::vector<std::deque<Diff>> diffs = dmp.diff_batch(pairs, 3);
+  std::vector<std::deque<Patch>> patches = dmp.patch_batch(pairs, 3);
+  assertEquals(L"diff_batch: Count.", static_cast<int>(pairs.size()), static_cast<int>(diffs.size()));
+  assertEquals(L"patch_batch: Count.", static_cast<int>(pairs.size()), static_cast<int>(patches.size()));
+  for (size_t i = 0; i < pairs.size(); i++) {
+    assertEquals(L"diff_batch: Pair " + std::to_wstring(i) + L".", dmp.diff_main(pairs[i].first, pairs[i].second), diffs[i]);
+    assertEquals(L"patch_batch: Pair " + std::to_wstring(i) + L".", dmp.patch_toText(dmp.patch_make(pairs[i].first, pairs[i].second)), dmp.patch_toText(patches[i]));
+  }
+
+  // More threads than pairs, and no pairs at all.
+  assertEquals(L"diff_batch: Threads.", dmp.diff_main(L"abc", L"ab123c"), dmp.diff_batch(std::vector<std::pair<std::wstring, std::wstring>>(1, pairs[1]), 8)[0]);
+  assertTrue(L"diff_batch: Empty.", dmp.diff_batch(std::vector<std::pair<std::wstring, std::wstring>>()).empty());
+
+  // Each pair gets the whole of Diff_Timeout, however many run at once.
+  text1 = L"`Twas brillig, and the slithy toves\nDid gyre and gimble in the wabe:\n";
+  text2 = L"I am the very model of a modern major general,\nI've information vegetable, animal, and mineral,\n";
+  for (int x = 0; x < 10; x++) {
+    text1 = text1 + text1;
+    text2 = text2 + text2;
+  }
+  const float timeout = dmp.Diff_Timeout;
+  dmp.Diff_Timeout = 0.1f;
+  std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+  dmp.diff_batch(std::vector<std::pair<std::wstring, std::wstring>>(4, std::make_pair(text1, text2)), 4);
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  assertTrue(L"diff_batch: Timeout.", dmp.Diff_Timeout <= elapsed);
+  dmp.Diff_Timeout = timeout;
+}
+
+void diff_match_patch_test::testOptions() {
+  diff_match_patch::Options options;
+  options.Diff_EditCost = 5;
+  options.Patch_Margin = 2;
+  const diff_match_patch engine(options);
+  assertEquals(L"Options: Copied.", 5, engine.options().Diff_EditCost);
+  assertEquals(L"Options: Copied.", 2, engine.Patch_Margin);
+  assertEquals(L"Options: Defaults.", 1000, engine.Match_Distance);
+
+  // A per-call override leaves the shared engine untouched.
+  diff_match_patch::Options overridden = engine.options();
+  overridden.Patch_Margin = 4;
+  assertEquals(L"Options: Override.", L"@@ -1,6 +1,5 @@\n Th\n-at\n+e\n  q\n", engine.patch_toText(engine.patch_make(L"That quick", L"The quick")));
+  assertEquals(L"Options: Override.", L"@@ -1,8 +1,7 @@\n Th\n-at\n+e\n  qui\n", diff_match_patch(overridden).patch_toText(diff_match_patch(overridden).patch_make(L"That quick", L"The quick")));
+  assertEquals(L"Options: Unchanged.", 2, engine.Patch_Margin);
+
+  // Concurrent calls on one const engine agree with serial ones.
+  const std::wstring text1 = L"The quick brown fox jumps over the lazy dog.\nLine two.\n";
+  const std::wstring text2 = L"That quick brown fox jumped over a lazy dog.\nLine 2.\n";
+  const std::wstring expected = engine.patch_toText(engine.patch_make(text1, text2));
+  std::vector<std::wstring> results(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < results.size(); t++) {
+    threads.push_back(std::thread([&, t]() {
+      std::deque<Patch> patches = engine.patch_make(text1, text2);
+      results[t] = engine.patch_toText(patches) + engine.patch_apply(patches, text1).first;
+    }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (const std::wstring &result : results) {
+    assertEquals(L"Options: Concurrent.", expected + text2, result);
+  }
+}
+
+void diff_match_patch_test::testDiffHistogram() {
+  // Each character stands for a line, as produced by diff_linesToChars.
+  const clock_t deadline = std::numeric_limits<clock_t>::max();
+  assertEquals(L"diff_histogram: Null case.", diffList(), dmp.diff_histogram(L"", L"", deadline));
+
+  assertEquals(L"diff_histogram: Equality.", diffList(Diff(Diff::Operation::Equal, L"abc")), dmp.diff_histogram(L"abc", L"abc", deadline));
+
+  assertEquals(L"diff_histogram: Insertion.", diffList(Diff(Diff::Operation::Equal, L"ab"), Diff(Diff::Operation::Insert, L"123"), Diff(Diff::Operation::Equal, L"c")), dmp.diff_histogram(L"abc", L"ab123c", deadline));
+
+  // Swapped functions: the unique lines of one function anchor the diff.
+  assertEquals(L"diff_histogram: Swap.", diffList(Diff(Diff::Operation::Delete, L"f{a}"), Diff(Diff::Operation::Equal, L"g{b}"), Diff(Diff::Operation::Insert, L"f{a}")), dmp.diff_histogram(L"f{a}g{b}", L"g{b}f{a}", deadline));
+
+  // Anchors are found again on each side of the first one.
+  assertEquals(L"diff_histogram: Recursion.", diffList(Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"x"), Diff(Diff::Operation::Insert, L"y"), Diff(Diff::Operation::Equal, L"b"), Diff(Diff::Operation::Insert, L"z"), Diff(Diff::Operation::Equal, L"c")), dmp.diff_histogram(L"axbc", L"aybzc", deadline));
+
+  // Lines which are too common to anchor on are left to Myers.
+  std::wstring text1 = std::wstring(70, L'}') + L"x";
+  std::wstring text2 = L"y" + std::wstring(70, L'}');
+  assertEquals(L"diff_histogram: Fallback.", diffList(Diff(Diff::Operation::Insert, L"y"), Diff(Diff::Operation::Equal, std::wstring(70, L'}')), Diff(Diff::Operation::Delete, L"x")), dmp.diff_histogram(text1, text2, deadline));
+
+  // A line occurring Histogram_MaxOccurrences times still anchors, the first
+  // of its occurrences; one more and Myers takes the last instead.
+  text1 = L"b" + std::wstring(diff_match_patch::Histogram_MaxOccurrences, L'}') + L"c";
+  assertEquals(L"diff_histogram: Most occurrences.", diffList(Diff(Diff::Operation::Delete, L"b"), Diff(Diff::Operation::Insert, L"d"), Diff(Diff::Operation::Equal, L"}"), Diff(Diff::Operation::Delete, std::wstring(diff_match_patch::Histogram_MaxOccurrences - 1, L'}') + L"c"), Diff(Diff::Operation::Insert, L"e")), dmp.diff_histogram(text1, L"d}e", deadline));
+  text1 = L"b" + std::wstring(diff_match_patch::Histogram_MaxOccurrences + 1, L'}') + L"c";
+  assertEquals(L"diff_histogram: Too many occurrences.", diffList(Diff(Diff::Operation::Delete, L"b" + std::wstring(diff_match_patch::Histogram_MaxOccurrences, L'}')), Diff(Diff::Operation::Insert, L"d"), Diff(Diff::Operation::Equal, L"}"), Diff(Diff::Operation::Delete, L"c"), Diff(Diff::Operation::Insert, L"e")), dmp.diff_histogram(text1, L"d}e", deadline));
+
+  // Selected through the options, histogram diffs still rebuild both texts.
+  text1.clear();
+  text2.clear();
+  for (int x = 0; x < 30; x++) {
+    text1 += L"int f" + std::to_wstring(x) + L"() {\n  return " + std::to_wstring(x) + L";\n}\n\n";
+    text2 += L"int f" + std::to_wstring(x % 5 == 0 ? x + 100 : x) + L"() {\n  return " + std::to_wstring(x) + L";\n}\n\n";
+  }
+  dmp.Diff_Algorithm = diff_match_patch::DiffAlgorithm::Histogram;
+  std::deque<Diff> diffs = dmp.diff_main(text1, text2);
+  dmp.Diff_Algorithm = diff_match_patch::DiffAlgorithm::Myers;
+  std::deque<std::wstring> texts;
+  texts.push_back(text1);
+  texts.push_back(text2);
+  assertEquals(L"diff_histogram: Line mode.", texts, diff_rebuildtexts(diffs));
+}
+
+void diff_match_patch_test::testDiffAnchored() {
+  dmp.Diff_Anchoring = true;
+  // Unique lines pin the diff, the gaps between them are diffed separately.
+  assertEquals(L"diff_main (anchored): Gaps.", diffList(Diff(Diff::Operation::Equal, L"a\n"), Diff(Diff::Operation::Delete, L"b"), Diff(Diff::Operation::Insert, L"x"), Diff(Diff::Operation::Equal, L"\nc\n"), Diff(Diff::Operation::Delete, L"d"), Diff(Diff::Operation::Insert, L"y"), Diff(Diff::Operation::Equal, L"\ne\n")), dmp.diff_main(L"a\nb\nc\nd\ne\n", L"a\nx\nc\ny\ne\n", false));
+
+  // Swapped lines on either side of an anchor are diffed on their own.
+  assertEquals(L"diff_main (anchored): Swap.", diffList(Diff(Diff::Operation::Delete, L"1"), Diff(Diff::Operation::Insert, L"2"), Diff(Diff::Operation::Equal, L"\nx\n"), Diff(Diff::Operation::Delete, L"2"), Diff(Diff::Operation::Insert, L"1"), Diff(Diff::Operation::Equal, L"\nx\n3\n")), dmp.diff_main(L"1\nx\n2\nx\n3\n", L"2\nx\n1\nx\n3\n", false));
+
+  // Large texts with scattered edits rebuild, streamed or not.
+  std::wstring text1, text2;
+  for (int x = 0; x < 300; x++) {
+    text1 += L"line " + std::to_wstring(x) + L"\n{\n}\n";
+    text2 += L"line " + std::to_wstring(x % 17 == 0 ? x * 3 : x) + L"\n{\n}\n";
+  }
+  std::deque<Diff> diffs = dmp.diff_main(text1, text2);
+  std::deque<std::wstring> texts;
+  texts.push_back(text1);
+  texts.push_back(text2);
+  assertEquals(L"diff_main (anchored): Rebuild.", texts, diff_rebuildtexts(diffs));
+  std::deque<Diff> streamed;
+  dmp.diff_main(text1, text2, true, [&streamed](Diff::Operation op, const std::wstring &text) {
+    streamed.push_back(Diff(op, text));
+  });
+  assertEquals(L"diff_main (anchored): Stream.", texts, diff_rebuildtexts(streamed));
+  dmp.Diff_Anchoring = false;
+}
+
+void diff_match_patch_test::testDiffBitParallel() {
+  const clock_t deadline = std::numeric_limits<clock_t>::max();
+  assertEquals(L"diff_bitParallel: Null case.", diffList(), dmp.diff_bitParallel(L"", L"", deadline));
+
+  assertEquals(L"diff_bitParallel: Insertion.", diffList(Diff(Diff::Operation::Insert, L"abc")), dmp.diff_bitParallel(L"", L"abc", deadline));
+
+  assertEquals(L"diff_bitParallel: Simple.", diffList(Diff(Diff::Operation::Delete, L"c"), Diff(Diff::Operation::Insert, L"m"), Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"t"), Diff(Diff::Operation::Insert, L"p")), dmp.diff_bitParallel(L"cat", L"map", deadline));
+
+  // Earliest matches are taken, as diff_bisect does.
+  assertEquals(L"diff_bitParallel: Earliest.", diffList(Diff(Diff::Operation::Delete, L"1"), Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"y"), Diff(Diff::Operation::Equal, L"b"), Diff(Diff::Operation::Delete, L"2"), Diff(Diff::Operation::Insert, L"xab")), dmp.diff_bitParallel(L"1ayb2", L"abxab", deadline));
+
+  // Texts spanning several words give diffs as short as diff_bisect's.
+  unsigned int seed = 1;
+  bool minimal = true;
+  for (int x = 0; x < 50; x++) {
+    std::wstring text1, text2;
+    for (int y = 0; y < 150; y++) {
+      seed = seed * 1103515245 + 12345;
+      text1 += static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+      seed = seed * 1103515245 + 12345;
+      text2 += static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+    }
+    std::deque<Diff> diffs = dmp.diff_bitParallel(text1, text2, deadline);
+    std::deque<Diff> bisected = dmp.diff_bisect(text1, text2, deadline);
+    minimal = minimal && dmp.diff_text1(diffs) == text1 && dmp.diff_text2(diffs) == text2;
+    int edits = 0;
+    int bisectedEdits = 0;
+    for (const Diff &aDiff : diffs) {
+      edits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+    }
+    for (const Diff &aDiff : bisected) {
+      bisectedEdits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+    }
+    minimal = minimal && edits == bisectedEdits;
+  }
+  assertTrue(L"diff_bitParallel: Multi-word.", minimal);
+
+  assertEquals(L"diff_bitParallel: Timeout.", diffList(Diff(Diff::Operation::Delete, L"cat"), Diff(Diff::Operation::Insert, L"map")), dmp.diff_bitParallel(L"cat", L"map", 0));
+}
+
+void diff_match_patch_test::testDiffOnp() {
+  const clock_t deadline = std::numeric_limits<clock_t>::max();
+  assertEquals(L"diff_onp: Simple.", diffList(Diff(Diff::Operation::Delete, L"c"), Diff(Diff::Operation::Insert, L"m"), Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"t"), Diff(Diff::Operation::Insert, L"p")), dmp.diff_onp(L"cat", L"map", deadline));
+
+  // The longer text may come first or second.
+  assertEquals(L"diff_onp: Append.", diffList(Diff(Diff::Operation::Equal, L"a=1"), Diff(Diff::Operation::Insert, L"\nb=2\nc=3")), dmp.diff_onp(L"a=1", L"a=1\nb=2\nc=3", deadline));
+  assertEquals(L"diff_onp: Truncate.", diffList(Diff(Diff::Operation::Equal, L"a=1"), Diff(Diff::Operation::Delete, L"\nb=2\nc=3")), dmp.diff_onp(L"a=1\nb=2\nc=3", L"a=1", deadline));
+
+  // As short as diff_bisect's diffs on lopsided texts.
+  unsigned int seed = 1;
+  bool minimal = true;
+  for (int x = 0; x < 50; x++) {
+    std::wstring text1, text2;
+    for (int y = 0; y < 200; y++) {
+      seed = seed * 1103515245 + 12345;
+      if (y < 30) {
+        text1 += static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+      }
+      text2 += static_cast<wchar_t>(L'a' + (seed >> 20) % 4);
+    }
+    if (x % 2 == 1) {
+      std::swap(text1, text2);
+    }
+    std::deque<Diff> diffs = dmp.diff_onp(text1, text2, deadline);
+    std::deque<Diff> bisected = dmp.diff_bisect(text1, text2, deadline);
+    int edits = 0;
+    int bisectedEdits = 0;
+    for (const Diff &aDiff : diffs) {
+      edits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+    }
+    for (const Diff &aDiff : bisected) {
+      bisectedEdits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+    }
+    minimal = minimal && dmp.diff_text1(diffs) == text1 && dmp.diff_text2(diffs) == text2
+        && edits == bisectedEdits;
+  }
+  assertTrue(L"diff_onp: Minimal.", minimal);
+
+  // Selected through the options.
+  dmp.Diff_Algorithm = diff_match_patch::DiffAlgorithm::ONP;
+  assertEquals(L"diff_main (O(NP)): Overlap.", diffList(Diff(Diff::Operation::Insert, L"xaxcx"), Diff(Diff::Operation::Equal, L"abc"), Diff(Diff::Operation::Delete, L"y")), dmp.diff_main(L"abcy", L"xaxcxabc", false));
+  dmp.Diff_Algorithm = diff_match_patch::DiffAlgorithm::Myers;
+}
+
+void diff_match_patch_test::testDiffPlan() {
+  // Words are runs of letters and digits, runs of whitespace or single characters.
+  std::deque<std::wstring> tmpVector;
+  tmpVector.push_back(L"");
+  tmpVector.push_back(L"a1");
+  tmpVector.push_back(L" ");
+  tmpVector.push_back(L"b");
+  tmpVector.push_back(L"  ");
+  tmpVector.push_back(L"(");
+  assertEquals(L"diff_wordsToChars: Shared words.", std::make_tuple(std::wstring(L"\u0001\u0002\u0003"), std::wstring(L"\u0003\u0004\u0005\u0001"), tmpVector), dmp.diff_wordsToChars(L"a1 b", L"b  (a1"));
+
+  // Source-like texts: short lines, or the same with very long lines.
+  unsigned int seed = 1;
+  std::wstring lines1, lines2, words1, words2;
+  for (int x = 0; x < 300; x++) {
+    seed = seed * 1103515245 + 12345;
+    const std::wstring line = L"value" + std::to_wstring(seed % 1000) + L" = f(" + std::to_wstring(x) + L");\n";
+    lines1 += line;
+    lines2 += seed % 10 == 0 ? L"changed();\n" : line;
+    words1 += line.substr(0, line.length() - 1) + (x % 30 == 29 ? L"\n" : L" ");
+    words2 += (seed % 10 == 0 ? L"changed();" : line.substr(0, line.length() - 1)) + (x % 30 == 29 ? L"\n" : L" ");
+  }
+
+  // The classic rules.
+  assertEquals(L"diff_plan: Trivial.", DiffPlan::strStrategy(DiffPlan::Strategy::Trivial), DiffPlan::strStrategy(dmp.diff_plan(L"abc", L"abXc").strategy));
+  assertEquals(L"diff_plan: Small.", L"DiffPlan(BitParallel: the texts are small enough for bit vectors)", dmp.diff_plan(L"cat", L"map").toString());
+  assertEquals(L"diff_plan: Line mode.", DiffPlan::strStrategy(DiffPlan::Strategy::LineMode), DiffPlan::strStrategy(dmp.diff_plan(lines1, lines2).strategy));
+  assertEquals(L"diff_plan: No line mode.", DiffPlan::strStrategy(DiffPlan::Strategy::Bisect), DiffPlan::strStrategy(dmp.diff_plan(lines1, lines2, false).strategy));
+  dmp.Diff_LineModeLength = 1000000;
+  assertEquals(L"diff_plan: Tuned line mode length.", DiffPlan::strStrategy(DiffPlan::Strategy::Bisect), DiffPlan::strStrategy(dmp.diff_plan(lines1, lines2).strategy));
+  dmp.Diff_LineModeLength = 100;
+
+  // The adaptive rules.
+  dmp.Diff_Algorithm = diff_match_patch::DiffAlgorithm::Auto;
+  assertEquals(L"diff_plan (auto): Small.", DiffPlan::strStrategy(DiffPlan::Strategy::BitParallel), DiffPlan::strStrategy(dmp.diff_plan(L"cat", L"map").strategy));
+
+  DiffPlan plan = dmp.diff_plan(lines1, lines2);
+  assertEquals(L"diff_plan (auto): Lines.", DiffPlan::strStrategy(DiffPlan::Strategy::LineMode), DiffPlan::strStrategy(plan.strategy));
+  assertTrue(L"diff_plan (auto): Shared lines.", plan.anchored && plan.lineSimilarity >= 0.5);
+
+  plan = dmp.diff_plan(words1, words2);
+  assertEquals(L"diff_plan (auto): Long lines.", DiffPlan::strStrategy(DiffPlan::Strategy::WordMode), DiffPlan::strStrategy(plan.strategy));
+  assertFalse(L"diff_plan (auto): Few lines.", plan.anchored);
+
+  std::wstring binary1, binary2;
+  for (int x = 0; x < 3000; x++) {
+    seed = seed * 1103515245 + 12345;
+    binary1 += (seed >> 16) % 2 ? L'0' : L'1';
+    binary2 += (seed >> 17) % 2 ? L'0' : L'1';
+  }
+  plan = dmp.diff_plan(binary1, binary2);
+  assertEquals(L"diff_plan (auto): Small alphabet.", DiffPlan::strStrategy(DiffPlan::Strategy::Bisect), DiffPlan::strStrategy(plan.strategy));
+  assertEquals(L"diff_plan (auto): Alphabet.", 2, plan.alphabet);
+
+  dmp.Diff_BitParallelCells = 0;
+  assertEquals(L"diff_plan (auto): Lopsided.", DiffPlan::strStrategy(DiffPlan::Strategy::ONP), DiffPlan::strStrategy(dmp.diff_plan(L"12x45", L"1" + std::wstring(100, L'a') + L"5").strategy));
+  dmp.Diff_ONPRatio = 1000;
+  assertEquals(L"diff_plan (auto): Tuned ratio.", DiffPlan::strStrategy(DiffPlan::Strategy::Bisect), DiffPlan::strStrategy(dmp.diff_plan(L"12x45", L"1" + std::wstring(100, L'a') + L"5").strategy));
+  dmp.Diff_ONPRatio = 4;
+  dmp.Diff_BitParallelCells = int64_t(1) << 22;
+
+  // Whatever the plan, the diff is a diff.
+  for (const auto &texts : {std::make_pair(lines1, lines2), std::make_pair(words1, words2), std::make_pair(binary1, binary2)}) {
+    std::deque<Diff> diffs = dmp.diff_main(texts.first, texts.second);
+    assertEquals(L"diff_main (auto): Text1.", texts.first, dmp.diff_text1(diffs));
+    assertEquals(L"diff_main (auto): Text2.", texts.second, dmp.diff_text2(diffs));
+  }
+  dmp.Diff_Algorithm = diff_match_patch::DiffAlgorithm::Myers;
+}
+
+void diff_match_patch_test::testDiffRace() {
+  unsigned int seed = 1;
+  std::wstring text1, text2;
+  for (int x = 0; x < 500; x++) {
+    seed = seed * 1103515245 + 12345;
+    const std::wstring line = L"value" + std::to_wstring(seed % 1000) + L" = f(" + std::to_wstring(x) + L");\n";
+    text1 += line;
+    text2 += seed % 7 == 0 ? L"value" + std::to_wstring(seed % 1000) + L" = g(" + std::to_wstring(x) + L");\n" : line;
+  }
+  const std::deque<Diff> single = dmp.diff_main(text1, text2);
+  long singleEdits = 0;
+  for (const Diff &aDiff : single) {
+    singleEdits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+  }
+
+  dmp.Diff_Race = true;
+  assertEquals(L"diff_main (race): Small.", diffList(Diff(Diff::Operation::Delete, L"c"), Diff(Diff::Operation::Insert, L"m"), Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"t"), Diff(Diff::Operation::Insert, L"p")), dmp.diff_main(L"cat", L"map"));
+
+  // With no slack the cheapest in by the time the configured one is done wins.
+  dmp.Diff_RaceSlack = 0;
+  std::deque<Diff> diffs = dmp.diff_main(text1, text2);
+  long edits = 0;
+  for (const Diff &aDiff : diffs) {
+    edits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+  }
+  assertTrue(L"diff_main (race): Cheapest.", edits <= singleEdits);
+  assertEquals(L"diff_main (race): Text1.", text1, dmp.diff_text1(diffs));
+  assertEquals(L"diff_main (race): Text2.", text2, dmp.diff_text2(diffs));
+
+  // With plenty of slack the first one in wins and the rest are cancelled.
+  dmp.Diff_RaceSlack = 100;
+  diffs = dmp.diff_main(text1, text2);
+  assertEquals(L"diff_main (race): First text1.", text1, dmp.diff_text1(diffs));
+  assertEquals(L"diff_main (race): First text2.", text2, dmp.diff_text2(diffs));
+
+  // Swapped lines cost nothing by the bound, so no contender reaches it and
+  // the race ends with the configured one.
+  dmp.Diff_RaceSlack = 0.1f;
+  std::wstring swapped = text1.substr(text1.find(L'\n') + 1);
+  swapped.insert(swapped.find(L'\n') + 1, text1.substr(0, text1.find(L'\n') + 1));
+  auto editCost = [](const std::deque<Diff> &diffs) {
+    long cost = 0;
+    for (const Diff &aDiff : diffs) {
+      cost += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+    }
+    return cost;
+  };
+  dmp.Diff_Race = false;
+  const long swappedEdits = editCost(dmp.diff_main(text1, swapped));
+  dmp.Diff_Race = true;
+  diffs = dmp.diff_main(text1, swapped);
+  assertTrue(L"diff_main (race): Swapped lines.", editCost(diffs) <= swappedEdits);
+  assertEquals(L"diff_main (race): Swapped text2.", swapped, dmp.diff_text2(diffs));
+  dmp.Diff_Race = false;
+}
+
+void diff_match_patch_test::testDiffBounded() {
+  std::deque<Diff> diffs;
+  assertTrue(L"diff_bounded: Equality.", dmp.diff_bounded(L"abc", L"abc", 0, diffs));
+  assertEquals(L"diff_bounded: Equality diffs.", diffList(Diff(Diff::Operation::Equal, L"abc")), diffs);
+
+  assertTrue(L"diff_bounded: Within.", dmp.diff_bounded(L"abc", L"axc", 2, diffs));
+  assertEquals(L"diff_bounded: Within diffs.", diffList(Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"b"), Diff(Diff::Operation::Insert, L"x"), Diff(Diff::Operation::Equal, L"c")), diffs);
+
+  // Out of bounds leaves the diffs alone.
+  assertFalse(L"diff_bounded: Exceeded.", dmp.diff_bounded(L"abc", L"axc", 1, diffs));
+  assertEquals(L"diff_bounded: Exceeded diffs.", diffList(Diff(Diff::Operation::Equal, L"a"), Diff(Diff::Operation::Delete, L"b"), Diff(Diff::Operation::Insert, L"x"), Diff(Diff::Operation::Equal, L"c")), diffs);
+  assertFalse(L"diff_bounded: Lengths.", dmp.diff_bounded(L"a", L"abcd", 2, diffs));
+  assertFalse(L"diff_bounded: Rearranged.", dmp.diff_bounded(L"abcdef", L"fedcba", 8, diffs));
+  assertTrue(L"diff_bounded: Nothing in common.", dmp.diff_bounded(L"abc", L"xyz", 6, diffs));
+  assertEquals(L"diff_bounded: Nothing in common diffs.", diffList(Diff(Diff::Operation::Delete, L"abc"), Diff(Diff::Operation::Insert, L"xyz")), diffs);
+
+  // As short as diff_bisect's diffs, and found just when they fit.
+  const clock_t deadline = std::numeric_limits<clock_t>::max();
+  unsigned int seed = 1;
+  bool minimal = true;
+  for (int x = 0; x < 50; x++) {
+    std::wstring text1, text2;
+    for (int y = 0; y < 100; y++) {
+      seed = seed * 1103515245 + 12345;
+      const wchar_t ch = static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+      text1 += ch;
+      text2 += (seed >> 20) % 8 == 0 ? static_cast<wchar_t>(L'a' + (seed >> 24) % 4) : ch;
+    }
+    int edits = 0;
+    for (const Diff &aDiff : dmp.diff_bisect(text1, text2, deadline)) {
+      edits += aDiff.operation == Diff::Operation::Equal ? 0 : aDiff.text.length();
+    }
+    minimal = minimal && dmp.diff_bounded(text1, text2, edits, diffs)
+        && dmp.diff_text1(diffs) == text1 && dmp.diff_text2(diffs) == text2
+        && (edits == 0 || !dmp.diff_bounded(text1, text2, edits - 1, diffs));
+  }
+  assertTrue(L"diff_bounded: Minimal.", minimal);
+}
+
+void diff_match_patch_test::testDiffSimilarWithin() {
+  assertTrue(L"diff_similarWithin: Equality.", dmp.diff_similarWithin(L"abc", L"abc", 0));
+  assertTrue(L"diff_similarWithin: Empty.", dmp.diff_similarWithin(L"", L"abc", 3));
+  assertFalse(L"diff_similarWithin: Too short.", dmp.diff_similarWithin(L"", L"abc", 2));
+  // Substitutions count once.
+  assertTrue(L"diff_similarWithin: Kitten.", dmp.diff_similarWithin(L"kitten", L"sitting", 3));
+  assertFalse(L"diff_similarWithin: Not kitten.", dmp.diff_similarWithin(L"kitten", L"sitting", 2));
+
+  // Both the banded and the bit-vector checks agree with the distance worked
+  // out cell by cell.
+  unsigned int seed = 1;
+  bool agree = true;
+  for (int x = 0; x < 100; x++) {
+    std::wstring text1, text2;
+    for (int y = 0; y < 150; y++) {
+      seed = seed * 1103515245 + 12345;
+      const wchar_t ch = static_cast<wchar_t>(L'a' + (seed >> 16) % 4);
+      text1 += ch;
+      if ((seed >> 20) % 32 != 0) {
+        text2 += ch;
+      } else if ((seed >> 24) % 2 == 0) {
+        text2 += static_cast<wchar_t>(L'a' + (seed >> 26) % 4);
+      }
+    }
+    std::vector<int> previous(text2.length() + 1), row(text2.length() + 1);
+    for (size_t j = 0; j <= text2.length(); j++) {
+      previous[j] = j;
+    }
+    for (size_t i = 1; i <= text1.length(); i++) {
+      row[0] = i;
+      for (size_t j = 1; j <= text2.length(); j++) {
+        row[j] = std::min(std::min(previous[j], row[j - 1]) + 1,
+                          previous[j - 1] + (text1[i - 1] != text2[j - 1]));
+      }
+      previous.swap(row);
+    }
+    const int distance = previous[text2.length()];
+    for (int maxEdits : {distance - 1, distance, 2 * distance, 4 * distance}) {
+      agree = agree && dmp.diff_similarWithin(text1, text2, maxEdits) == (distance <= maxEdits)
+          && dmp.diff_similarWithin(text2, text1, maxEdits) == (distance <= maxEdits);
+    }
+  }
+  assertTrue(L"diff_similarWithin: Distance.", agree);
+}
+
+void diff_match_patch_test::testDiffStats() {
+  assertEquals(L"diff_stats: Null case.", L"DiffStats(=0 -0 +0, lines -0/0 +0/0, 0 hunks, levenshtein 0)", dmp.diff_stats(L"", L"").toString());
+  assertEquals(L"diff_stats: Lines.", L"DiffStats(=6 -1 +4, lines -1/3 +2/4, 2 hunks, levenshtein 4)", dmp.diff_stats(L"a\nbc\nd\n", L"a\nXYc\nd\nef").toString());
+
+  // The same figures as diff_main's diffs, and the texts themselves.
+  unsigned int seed = 1;
+  std::wstring text1, text2;
+  for (int x = 0; x < 400; x++) {
+    seed = seed * 1103515245 + 12345;
+    const std::wstring line = L"value" + std::to_wstring(seed % 1000) + L" = f(" + std::to_wstring(x) + L");\n";
+    text1 += line;
+    text2 += seed % 5 == 0 ? L"changed();\n" : line;
+  }
+  const DiffStats stats = dmp.diff_stats(text1, text2);
+  assertEquals(L"diff_stats: Levenshtein.", dmp.diff_levenshtein(dmp.diff_main(text1, text2)), stats.levenshtein);
+  assertEquals(L"diff_stats: Text1.", static_cast<long>(text1.length()), stats.equalChars + stats.deletedChars);
+  assertEquals(L"diff_stats: Text2.", static_cast<long>(text2.length()), stats.equalChars + stats.insertedChars);
+  assertEquals(L"diff_stats: Lines of text1.", 400, stats.lines1);
+  assertEquals(L"diff_stats: Lines of text2.", 400, stats.lines2);
+  // 87 of the lines are replaced.
+  assertEquals(L"diff_stats: Deleted lines.", 87, stats.deletedLines);
+  assertEquals(L"diff_stats: Inserted lines.", 87, stats.insertedLines);
+
+  // Random line-structured pairs, in line mode, agree with diff_main too.
+  bool agree = true;
+  for (int x = 0; x < 300; x++) {
+    std::wstring a, b;
+    for (int y = 0; y < 40; y++) {
+      seed = seed * 1103515245 + 12345;
+      const std::wstring line = L"line " + std::to_wstring((seed >> 8) % 12) + L"\n";
+      a += line;
+      seed = seed * 1103515245 + 12345;
+      switch ((seed >> 8) % 4) {
+        case 0: b += L"new " + std::to_wstring((seed >> 12) % 12) + L"\n"; break;
+        case 1: break;
+        case 2: b += line + line; break;
+        default: b += line; break;
+      }
+    }
+    const std::deque<Diff> diffs = dmp.diff_main(a, b, true);
+    long inserted = 0;
+    for (const Diff &diff : diffs) {
+      inserted += diff.operation == Diff::Operation::Insert ? diff.text.length() : 0;
+    }
+    const DiffStats found = dmp.diff_stats(a, b, true);
+    agree = agree && found.levenshtein == dmp.diff_levenshtein(diffs)
+        && found.insertedChars == inserted
+        && found.equalChars + found.deletedChars == static_cast<long>(dmp.diff_text1(diffs).length())
+        && found.equalChars + found.insertedChars == static_cast<long>(dmp.diff_text2(diffs).length());
+  }
+  assertTrue(L"diff_stats: Random lines.", agree);
+}
+
 
 //  MATCH TEST FUNCTIONS
 
@@ -635,6 +1401,18 @@ void diff_match_patch_test::testMatchAlphabet() {
   bitmask.emplace(L'b', 18);
   bitmask.emplace(L'c', 8);
   assertEquals(L"match_alphabet: Duplicates.", bitmask, dmp.match_alphabet(L"abcaba"));
+
+  // The compiled alphabet has the same masks, whatever the characters.
+  const std::wstring pattern = L"a\u00e9b\u4e2d\u00e9a\U0001F600\u03b1\u03b2\u03b3z";
+  const MatchAlphabet alphabet(pattern);
+  bool same = true;
+  for (const auto &entry : dmp.match_alphabet(pattern)) {
+    same = same && alphabet[entry.first][0] == static_cast<uint64_t>(entry.second);
+  }
+  for (wchar_t c : {L'c', L'\u00e8', L'\u4e2e', L'\u03b4', L'\0'}) {
+    same = same && alphabet[c][0] == 0;
+  }
+  assertTrue(L"MatchAlphabet: Same masks.", same);
 }
 
 void diff_match_patch_test::testMatchBitap() {
@@ -680,6 +1458,414 @@ void diff_match_patch_test::testMatchBitap() {
 
   dmp.Match_Distance = 1000;  // Loose location.
   assertEquals(L"match_bitap: Distance test #3.", 0, dmp.match_bitap(L"abcdefghijklmnopqrstuvwxyz", L"abcdefg", 24));
+
+  // Patterns over a word long, with errors either side of the word boundary.
+  std::wstring text;
+  for (int x = 0; x < 30; x++) {
+    text += L"line " + std::to_wstring(x * x) + L";";
+  }
+  dmp.Match_MaxBits = 200;
+  for (int length : {64, 65, 100, 200}) {
+    std::wstring pattern = text.substr(40, length);
+    pattern[3] = L'#';
+    pattern[63] = L'#';
+    pattern.erase(length - 10, 1);
+    assertEquals(L"match_bitap: Long pattern " + std::to_wstring(length) + L".", 40, dmp.match_bitap(text, pattern, 50));
+  }
+  dmp.Match_MaxBits = 100;
+  try {
+    dmp.match_bitap(text, text.substr(0, 101), 0);
+    assertFalse(L"match_bitap: Pattern too long.", true);
+  } catch (const char *) {
+    // Exception expected.
+  }
+  dmp.Match_MaxBits = 64;
+
+  // How far from loc a match may be, as a binary search over the score finds.
+  dmp.Match_Distance = 100;
+  assertEquals(L"match_bitapReach: Errors.", 30, dmp.match_bitapReach(2, 0, L"abcdefghij", 0.5, 1000));
+  assertEquals(L"match_bitapReach: Capped.", 20, dmp.match_bitapReach(2, 0, L"abcdefghij", 0.5, 20));
+  assertEquals(L"match_bitapReach: Out of reach.", 0, dmp.match_bitapReach(6, 0, L"abcdefghij", 0.5, 1000));
+  dmp.Match_Distance = 10;
+  assertEquals(L"match_bitapReach: Rounding.", 3, dmp.match_bitapReach(0, 0, L"abcdefghij", 0.3f, 1000));
+  dmp.Match_Distance = 0;
+  assertEquals(L"match_bitapReach: No distance.", 0, dmp.match_bitapReach(0, 0, L"abcdefghij", 0.5, 1000));
+
+  // The same matches as one error level at a time.
+  unsigned int seed = 5;
+  auto randomised = [&](int calls, int shortest, int longest_pattern, int farthest) {
+    bool same = true;
+    for (int x = 0; x < calls; x++) {
+      seed = seed * 1103515245 + 12345;
+      dmp.Match_Distance = (seed >> 16) % 5 == 0 ? 0 : (seed >> 16) % farthest;
+      seed = seed * 1103515245 + 12345;
+      dmp.Match_Threshold = ((seed >> 16) % 100) / 100.0f;
+      const int length = shortest + x % 2000;
+      text.clear();
+      for (int y = 0; y < length; y++) {
+        seed = seed * 1103515245 + 12345;
+        text += static_cast<wchar_t>(L'a' + (seed >> 16) % 5);
+      }
+      // A piece of the text with some characters changed.
+      const int pattern_length = 1 + x % longest_pattern;
+      seed = seed * 1103515245 + 12345;
+      std::wstring pattern = text.substr((seed >> 16) % (length - pattern_length), pattern_length);
+      for (wchar_t &c : pattern) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 4 == 0) {
+          c = static_cast<wchar_t>(L'a' + (seed >> 20) % 5);
+        }
+      }
+      seed = seed * 1103515245 + 12345;
+      const int loc = (seed >> 16) % length;
+      same = same && dmp.match_bitap(text, pattern, loc) == match_bitapReference(text, pattern, loc);
+    }
+    return same;
+  };
+  assertTrue(L"match_bitap: Randomised.", randomised(3000, 100, 32, 3000));
+  dmp.Match_MaxBits = 0;
+  assertTrue(L"match_bitap: Randomised multi-word.", randomised(300, 100, 150, 3000));
+  // Windows too wide for a whole group of levels at once.
+  assertTrue(L"match_bitap: Randomised wide.", randomised(20, 20000, 70, 60000));
+  // And one level at a time.
+  text.clear();
+  for (int x = 0; x < 100000; x++) {
+    seed = seed * 1103515245 + 12345;
+    text += static_cast<wchar_t>(L'a' + (seed >> 16) % 26);
+  }
+  std::wstring pattern = text.substr(90000, 20);
+  pattern[5] = L'#';
+  pattern[15] = L'#';
+  dmp.Match_Distance = 1000000;
+  dmp.Match_Threshold = 0.5f;
+  assertEquals(L"match_bitap: Widest.", match_bitapReference(text, pattern, 10000), dmp.match_bitap(text, pattern, 10000));
+  dmp.Match_MaxBits = 64;
+  dmp.Match_Distance = 1000;
+  dmp.Match_Threshold = 0.5f;
+}
+
+void diff_match_patch_test::testMatchMyers() {
+  // Myers' bit-vector algorithm, scored as Bitap.
+  dmp.Match_Distance = 100;
+  dmp.Match_Threshold = 0.5f;
+  assertEquals(L"match_myers: Exact match #1.", 5, dmp.match_myers(L"abcdefghijk", L"fgh", 5));
+
+  assertEquals(L"match_myers: Exact match #2.", 5, dmp.match_myers(L"abcdefghijk", L"fgh", 0));
+
+  assertEquals(L"match_myers: Fuzzy match #1.", 4, dmp.match_myers(L"abcdefghijk", L"efxhi", 0));
+
+  assertEquals(L"match_myers: Fuzzy match #2.", 2, dmp.match_myers(L"abcdefghijk", L"cdefxyhijk", 5));
+
+  assertEquals(L"match_myers: Fuzzy match #3.", -1, dmp.match_myers(L"abcdefghijk", L"bxy", 1));
+
+  assertEquals(L"match_myers: Overflow.", 2, dmp.match_myers(L"123456789xx0", L"3456789x0", 2));
+
+  assertEquals(L"match_myers: Before start match.", 0, dmp.match_myers(L"abcdef", L"xxabc", 4));
+
+  assertEquals(L"match_myers: Beyond end match.", 3, dmp.match_myers(L"abcdef", L"defyy", 4));
+
+  assertEquals(L"match_myers: Oversized pattern.", 0, dmp.match_myers(L"abcdef", L"xabcdefy", 0));
+
+  dmp.Match_Threshold = 0.4f;
+  assertEquals(L"match_myers: Threshold #1.", 4, dmp.match_myers(L"abcdefghijk", L"efxyhi", 1));
+
+  dmp.Match_Threshold = 0.3f;
+  assertEquals(L"match_myers: Threshold #2.", -1, dmp.match_myers(L"abcdefghijk", L"efxyhi", 1));
+
+  dmp.Match_Threshold = 0.0f;
+  assertEquals(L"match_myers: Threshold #3.", 1, dmp.match_myers(L"abcdefghijk", L"bcdef", 1));
+
+  dmp.Match_Threshold = 0.5f;
+  assertEquals(L"match_myers: Multiple select #1.", 0, dmp.match_myers(L"abcdexyzabcde", L"abccde", 3));
+
+  assertEquals(L"match_myers: Multiple select #2.", 8, dmp.match_myers(L"abcdexyzabcde", L"abccde", 5));
+
+  dmp.Match_Distance = 10;  // Strict location.
+  assertEquals(L"match_myers: Distance test #1.", -1, dmp.match_myers(L"abcdefghijklmnopqrstuvwxyz", L"abcdefg", 24));
+
+  assertEquals(L"match_myers: Distance test #2.", 0, dmp.match_myers(L"abcdefghijklmnopqrstuvwxyz", L"abcdxxefg", 1));
+
+  dmp.Match_Distance = 1000;  // Loose location.
+  assertEquals(L"match_myers: Distance test #3.", 0, dmp.match_myers(L"abcdefghijklmnopqrstuvwxyz", L"abcdefg", 24));
+
+  // Patterns over a word long, with errors either side of the word boundary.
+  std::wstring text;
+  for (int x = 0; x < 30; x++) {
+    text += L"line " + std::to_wstring(x * x) + L";";
+  }
+  dmp.Match_MaxBits = 200;
+  for (int length : {64, 65, 100, 200}) {
+    std::wstring pattern = text.substr(40, length);
+    pattern[3] = L'#';
+    pattern[63] = L'#';
+    pattern.erase(length - 10, 1);
+    assertEquals(L"match_myers: Long pattern " + std::to_wstring(length) + L".", 40, dmp.match_myers(text, pattern, 50));
+  }
+  dmp.Match_MaxBits = 64;
+
+  // Through match_main.
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Myers;
+  dmp.Match_Threshold = 0.7f;
+  assertEquals(L"match_myers: match_main.", 4, dmp.match_main(L"I am the very model of a modern major general.", L" that berry ", 5));
+  dmp.Match_Threshold = 0.5f;
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Bitap;
+}
+
+void diff_match_patch_test::testMatchIndex() {
+  // Q-gram index of a text.
+  MatchIndex index(L"abcabcxabc", 3);
+  assertEquals(L"MatchIndex: Count.", 3, static_cast<int>(index.count(L"abc")));
+  std::vector<int> found;
+  index.find(L"abc", 1, 7, found);
+  assertTrue(L"MatchIndex: Find.", found == std::vector<int>{3, 7});
+
+  // Edits reindex the substrings they touch and move the rest along.
+  index.replace(2, 2, L"ZZZZ");
+  assertEquals(L"MatchIndex: Replace text.", L"abZZZZbcxabc", index.text());
+  found.clear();
+  index.find(L"abc", 0, 100, found);
+  assertTrue(L"MatchIndex: Replace moves.", found == std::vector<int>{9});
+  found.clear();
+  index.find(L"ZZZ", 0, 100, found);
+  assertTrue(L"MatchIndex: Replace adds.", found == std::vector<int>{2, 3});
+  index.replace(0, 12, L"");
+  assertEquals(L"MatchIndex: Replace all.", 0, static_cast<int>(index.count(L"abc")));
+
+  // Blocks grown by edits are split, and the positions stay right.
+  MatchIndex grown(L"abcabcxabc", 3);
+  std::wstring expected = L"abcabcxabc";
+  for (int x = 0; x < 100; x++) {
+    grown.replace(4, 0, L"abc");
+    expected.insert(4, L"abc");
+  }
+  grown.replace(100, 50, L"");
+  expected.erase(100, 50);
+  assertEquals(L"MatchIndex: Grown text.", expected, grown.text());
+  int longest = 0;
+  for (size_t b = 0; b + 1 < grown.blockOrder.size(); b++) {
+    longest = std::max(longest, grown.blockStarts[grown.blockOrder[b + 1]] - grown.blockStarts[grown.blockOrder[b]]);
+  }
+  assertEquals(L"MatchIndex: Grown blocks split.", 64, longest);
+  found.clear();
+  grown.find(L"abc", 0, 1000, found);
+  std::vector<int> fresh;
+  MatchIndex(expected, 3).find(L"abc", 0, 1000, fresh);
+  assertTrue(L"MatchIndex: Grown positions.", found == fresh);
+
+  // Searches find what match_main finds with either engine, however the
+  // text was arrived at.
+  std::wstring text;
+  for (int x = 0; x < 300; x++) {
+    text += L"line " + std::to_wstring(x * x) + L";";
+  }
+  MatchIndex edited(text.substr(0, 1000) + L"[inserted]" + text.substr(1000), 4);
+  edited.replace(1000, 10, L"");
+  assertEquals(L"MatchIndex: Edited text.", text, edited.text());
+  dmp.Match_Distance = 1000;
+  dmp.Match_Threshold = 0.5f;
+  for (auto algorithm : {diff_match_patch::MatchAlgorithm::Bitap, diff_match_patch::MatchAlgorithm::Myers}) {
+    dmp.Match_Algorithm = algorithm;
+    const std::wstring engine = algorithm == diff_match_patch::MatchAlgorithm::Bitap ? L"Bitap" : L"Myers";
+    for (int loc : {0, 900, 2500}) {
+      for (int errors : {0, 3, 10}) {
+        std::wstring pattern = text.substr(1200, 40);
+        for (int e = 0; e < errors; e++) {
+          pattern[(e * 13) % 40] = L'#';
+        }
+        assertEquals(L"match_main: Index, " + engine + L", loc " + std::to_wstring(loc) + L", " + std::to_wstring(errors) + L" errors.",
+            dmp.match_main(text, pattern, loc), dmp.match_main(edited, pattern, loc));
+      }
+    }
+  }
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Bitap;
+
+  // patch_apply edits the text through the index.
+  std::wstring text2 = text;
+  text2.replace(300, 20, L"replaced");
+  text2.replace(2000, 0, L"inserted");
+  std::wstring drifted = text;
+  drifted.replace(100, 50, L"");
+  drifted[1990] = L'#';
+  const std::deque<Patch> patches = dmp.patch_make(text, text2);
+  const auto scanned = dmp.patch_apply(patches, drifted);
+  dmp.Patch_IndexGram = 4;
+  const auto indexed = dmp.patch_apply(patches, drifted);
+  dmp.Patch_IndexGram = 0;
+  assertEquals(L"patch_apply: Index.", scanned.first, indexed.first);
+  assertTrue(L"patch_apply: Index results.", scanned.second == indexed.second);
+}
+
+void diff_match_patch_test::testMatchMany() {
+  // Several patterns in one pass, each as match_main finds it.
+  dmp.Match_Distance = 1000;
+  dmp.Match_Threshold = 0.5f;
+  std::wstring text;
+  for (int x = 0; x < 300; x++) {
+    text += L"line " + std::to_wstring(x * x) + L";";
+  }
+  std::vector<std::wstring> patterns;
+  std::vector<int> locs;
+  for (int x = 0; x < 40; x++) {
+    std::wstring pattern = text.substr(x * 97 % 3000, 5 + x * 3 % 60);
+    for (int e = 0; e < x % 6; e++) {
+      pattern[(e * 7 + x) % pattern.length()] = L'#';
+    }
+    patterns.push_back(pattern);
+    locs.push_back(x % 3 == 0 ? x * 97 % 3000 : x * 211 % 3500);
+  }
+  // Shortcuts: the whole text, exactly at loc, and nowhere.
+  patterns.push_back(text);
+  locs.push_back(5);
+  patterns.push_back(text.substr(100, 20));
+  locs.push_back(100);
+  patterns.push_back(L"%%%%%%%%");
+  locs.push_back(0);
+  for (diff_match_patch::MatchAlgorithm algorithm :
+       {diff_match_patch::MatchAlgorithm::Bitap, diff_match_patch::MatchAlgorithm::Myers}) {
+    dmp.Match_Algorithm = algorithm;
+    const std::vector<int> results = dmp.match_many(text, patterns, locs);
+    for (size_t i = 0; i < patterns.size(); i++) {
+      assertEquals(L"match_many: Pattern " + std::to_wstring(i) + L".",
+                   dmp.match_main(text, patterns[i], locs[i]), results[i]);
+    }
+  }
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Bitap;
+
+  // Randomised texts and settings, with pieces of the text changed here and
+  // there for patterns, found as match_main finds them with either engine.
+  unsigned int seed = 11;
+  bool same[2] = {true, true};
+  dmp.Match_MaxBits = 0;
+  for (int x = 0; x < 100; x++) {
+    seed = seed * 1103515245 + 12345;
+    dmp.Match_Distance = (seed >> 16) % 5 == 0 ? 0 : (seed >> 16) % 3000;
+    seed = seed * 1103515245 + 12345;
+    dmp.Match_Threshold = ((seed >> 16) % 100) / 100.0f;
+    const int length = 100 + x * 13 % 3000;
+    text.clear();
+    for (int y = 0; y < length; y++) {
+      seed = seed * 1103515245 + 12345;
+      text += static_cast<wchar_t>(L'a' + (seed >> 16) % (x % 3 == 0 ? 4 : 26));
+    }
+    patterns.clear();
+    locs.clear();
+    for (int y = 0; y < 30; y++) {
+      const int pattern_length = std::min(1 + (x + y * 7) % 150, length - 1);
+      seed = seed * 1103515245 + 12345;
+      const int at = (seed >> 16) % (length - pattern_length);
+      std::wstring pattern = text.substr(at, pattern_length);
+      for (wchar_t &c : pattern) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % (2 + (x + y) % 10) == 0) {
+          c = static_cast<wchar_t>(L'a' + (seed >> 20) % 5);
+        }
+      }
+      seed = seed * 1103515245 + 12345;
+      patterns.push_back(pattern);
+      locs.push_back(std::max(0, y % 2 ? at + static_cast<int>((seed >> 16) % 41) - 20
+                                      : static_cast<int>((seed >> 16) % length)));
+    }
+    for (int a = 0; a < 2; a++) {
+      dmp.Match_Algorithm = a == 0 ? diff_match_patch::MatchAlgorithm::Bitap
+                                   : diff_match_patch::MatchAlgorithm::Myers;
+      const std::vector<int> results = dmp.match_many(text, patterns, locs);
+      for (size_t i = 0; i < patterns.size(); i++) {
+        same[a] = same[a] && results[i] == dmp.match_main(text, patterns[i], locs[i]);
+      }
+    }
+  }
+  assertTrue(L"match_many: Randomised, Bitap.", same[0]);
+  assertTrue(L"match_many: Randomised, Myers.", same[1]);
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Bitap;
+  dmp.Match_MaxBits = 64;
+  dmp.Match_Distance = 1000;
+  dmp.Match_Threshold = 0.5f;
+
+  assertEquals(L"match_many: Null text.", -1, dmp.match_many(L"", {L"abc"}, {0})[0]);
+}
+
+void diff_match_patch_test::testMatchCandidates() {
+  // The k best places, each overlapping match counted once.
+  dmp.Match_Distance = 100;
+  dmp.Match_Threshold = 0.5f;
+  std::vector<MatchCandidate> candidates = dmp.match_candidates(L"abcdef--abXdef--abcdef", L"abcdef", 8, 3);
+  assertEquals(L"match_candidates: Count.", 3, static_cast<int>(candidates.size()));
+  assertEquals(L"match_candidates: Best location.", 0, candidates[0].location);
+  assertEquals(L"match_candidates: Best errors.", 0, candidates[0].errors);
+  assertEquals(L"match_candidates: Second location.", 16, candidates[1].location);
+  assertEquals(L"match_candidates: Third location.", 8, candidates[2].location);
+  assertEquals(L"match_candidates: Third errors.", 1, candidates[2].errors);
+  assertTrue(L"match_candidates: Scores.", candidates[0].score <= candidates[1].score
+      && candidates[1].score <= candidates[2].score);
+
+  candidates = dmp.match_candidates(L"abcdef--abXdef--abcdef", L"abcdef", 8, 1);
+  assertEquals(L"match_candidates: k = 1.", dmp.match_myers(L"abcdef--abXdef--abcdef", L"abcdef", 8), candidates[0].location);
+
+  // The best candidate is where match_myers finds the pattern.
+  unsigned int seed = 5;
+  bool same = true;
+  for (int x = 0; x < 300; x++) {
+    seed = seed * 1103515245 + 12345;
+    dmp.Match_Distance = (seed >> 16) % 5 == 0 ? 0 : (seed >> 16) % 3000;
+    seed = seed * 1103515245 + 12345;
+    dmp.Match_Threshold = ((seed >> 16) % 100) / 100.0f;
+    const int length = 100 + x * 7 % 2000;
+    std::wstring text;
+    for (int y = 0; y < length; y++) {
+      seed = seed * 1103515245 + 12345;
+      text += static_cast<wchar_t>(L'a' + (seed >> 16) % 5);
+    }
+    const int pattern_length = 1 + x % 64;
+    seed = seed * 1103515245 + 12345;
+    std::wstring pattern = text.substr((seed >> 16) % (length - pattern_length), pattern_length);
+    for (wchar_t &c : pattern) {
+      seed = seed * 1103515245 + 12345;
+      if ((seed >> 16) % 4 == 0) {
+        c = static_cast<wchar_t>(L'a' + (seed >> 20) % 5);
+      }
+    }
+    seed = seed * 1103515245 + 12345;
+    const int loc = (seed >> 16) % length;
+    candidates = dmp.match_candidates(text, pattern, loc, 1);
+    same = same && (candidates.empty() ? -1 : candidates[0].location) == dmp.match_myers(text, pattern, loc);
+  }
+  assertTrue(L"match_candidates: Randomised.", same);
+  dmp.Match_Distance = 100;
+  dmp.Match_Threshold = 0.5f;
+
+  candidates = dmp.match_candidates(L"abcdef", L"", 2, 3);
+  assertEquals(L"match_candidates: Empty pattern.", 1, static_cast<int>(candidates.size()));
+  assertEquals(L"match_candidates: Empty pattern location.", 2, candidates[0].location);
+  assertTrue(L"match_candidates: Empty pattern score.", candidates[0].score == 0.0);
+
+  dmp.Match_Threshold = 0.1f;
+  candidates = dmp.match_candidates(L"abcdef--abXdef--abcdef", L"abcdef", 8, 3);
+  assertEquals(L"match_candidates: Threshold.", 2, static_cast<int>(candidates.size()));
+
+  assertTrue(L"match_candidates: Null text.", dmp.match_candidates(L"", L"abc", 0, 3).empty());
+
+  dmp.Match_Threshold = 0.5f;
+  dmp.Match_Distance = 1000;
+}
+
+void diff_match_patch_test::testMatchPattern() {
+  // A pattern compiled once matches like the string it came from.
+  const MatchPattern pattern(L" that berry ");
+  assertEquals(L"MatchPattern: Text.", L" that berry ", pattern.text());
+  assertEquals(L"MatchPattern: Alphabet.", dmp.match_alphabet(L" that berry ")[L'e'], static_cast<int>(pattern.alphabet()[L'e'][0]));
+  dmp.Match_Threshold = 0.7f;
+  assertEquals(L"MatchPattern: Complex match.", 4, dmp.match_main(L"I am the very model of a modern major general.", pattern, 5));
+  assertEquals(L"MatchPattern: Reused.", dmp.match_main(L"That merry man", L" that berry ", 0), dmp.match_main(L"That merry man", pattern, 0));
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Myers;
+  assertEquals(L"MatchPattern: Myers.", 4, dmp.match_main(L"I am the very model of a modern major general.", pattern, 5));
+  dmp.Match_Algorithm = diff_match_patch::MatchAlgorithm::Bitap;
+  dmp.Match_Threshold = 0.5f;
+
+  const MatchPattern exact(L"de");
+  assertEquals(L"MatchPattern: Exact match.", 3, dmp.match_main(L"abcdef", exact, 3));
+  assertEquals(L"MatchPattern: Null text.", -1, dmp.match_main(L"", exact, 1));
+  MatchIndex index(L"abcdef--abcdef", 2);
+  assertEquals(L"MatchPattern: Index.", dmp.match_main(index, L"de", 10), dmp.match_main(index, exact, 10));
 }
 
 void diff_match_patch_test::testMatchMain() {
@@ -802,13 +1988,20 @@ void diff_match_patch_test::testPatchMake() {
     text1 += L"abcdef";
   }
   text2 = text1 + L"123";
+  dmp.Match_MaxBits = 32;
   expectedPatch = L"@@ -573,28 +573,31 @@\n cdefabcdefabcdefabcdefabcdef\n+123\n";
   patches = dmp.patch_make(text1, text2);
   assertEquals(L"patch_make: Long string with repeats.", expectedPatch, dmp.patch_toText(patches));
+
+  // Context grows for as long as Match_MaxBits allows.
+  dmp.Match_MaxBits = 64;
+  expectedPatch = L"@@ -541,60 +541,63 @@\n abcdefabcdefabcdefabcdefabcdefabcdefabcdefabcdefabcdefabcdef\n+123\n";
+  patches = dmp.patch_make(text1, text2);
+  assertEquals(L"patch_make: Long string with repeats, 64 bits.", expectedPatch, dmp.patch_toText(patches));
 }
 
 void diff_match_patch_test::testPatchSplitMax() {
-  // Assumes that Match_MaxBits is 32.
+  dmp.Match_MaxBits = 32;
   std::deque<Patch> patches;
   patches = dmp.patch_make(L"abcdefghijklmnopqrstuvwxyz01234567890", L"XabXcdXefXghXijXklXmnXopXqrXstXuvXwxXyzX01X23X45X67X89X0");
   dmp.patch_splitMax(patches);
@@ -826,6 +2019,7 @@ void diff_match_patch_test::testPatchSplitMax() {
   patches = dmp.patch_make(L"abcdefghij , h : 0 , t : 1 abcdefghij , h : 0 , t : 1 abcdefghij , h : 0 , t : 1", L"abcdefghij , h : 1 , t : 1 abcdefghij , h : 1 , t : 1 abcdefghij , h : 0 , t : 1");
   dmp.patch_splitMax(patches);
   assertEquals(L"patch_splitMax: #4.", L"@@ -2,32 +2,32 @@\n bcdefghij , h : \n-0\n+1\n  , t : 1 abcdef\n@@ -29,32 +29,32 @@\n bcdefghij , h : \n-0\n+1\n  , t : 1 abcdef\n", dmp.patch_toText(patches));
+  dmp.Match_MaxBits = 64;
 }
 
 void diff_match_patch_test::testPatchAddPadding() {
@@ -847,6 +2041,7 @@ void diff_match_patch_test::testPatchAddPadding() {
 }
 
 void diff_match_patch_test::testPatchApply() {
+  dmp.Match_MaxBits = 32;
   dmp.Match_Distance = 1000;
   dmp.Match_Threshold = 0.5f;
   dmp.Patch_DeleteThreshold = 0.5f;
@@ -892,6 +2087,12 @@ void diff_match_patch_test::testPatchApply() {
   boolArray = results.second;
   resultStr = results.first + L"\t" + (boolArray[0] ? L"true" : L"false") + L"\t" + (boolArray[1] ? L"true" : L"false");
   assertEquals(L"patch_apply: Big delete, large change 2.", L"xabcy\ttrue\ttrue", resultStr);
+
+  dmp.Patch_DeleteThreshold = 1.0f;
+  results = dmp.patch_apply(patches, L"x12345678901234567890" + std::wstring(128, L'-') + L"12345678901234567890y");
+  boolArray = results.second;
+  resultStr = results.first + L"\t" + (boolArray[0] ? L"true" : L"false") + L"\t" + (boolArray[1] ? L"true" : L"false");
+  assertEquals(L"patch_apply: Big delete, content replaced.", L"xabc12345678901234567890" + std::wstring(128, L'-') + L"12345678901234567890y\tfalse\ttrue", resultStr);
   dmp.Patch_DeleteThreshold = 0.5f;
 
   dmp.Match_Threshold = 0.0f;
@@ -931,6 +2132,7 @@ void diff_match_patch_test::testPatchApply() {
   boolArray = results.second;
   resultStr = results.first + L"\t" + (boolArray[0] ? L"true" : L"false");
   assertEquals(L"patch_apply: Edge partial match.", L"x123\ttrue", resultStr);
+  dmp.Match_MaxBits = 64;
 }
 
 
@@ -1112,6 +2314,91 @@ void diff_match_patch_test::assertFalse(const std::wstring &strCase, bool value)
 }
 
 
+// Bitap as originally written, one error level at a time.
+int diff_match_patch_test::match_bitapReference(const std::wstring &text, const std::wstring &pattern, int loc) {
+  // The pattern's characters, last first, on as many 64-bit words as it needs.
+  const int words = (pattern.length() + 63) / 64;
+  std::map<wchar_t, std::vector<uint64_t>> s;
+  for (size_t i = 0; i < pattern.length(); i++) {
+    std::vector<uint64_t> &mask = s[pattern[i]];
+    mask.resize(words);
+    const size_t bit = pattern.length() - i - 1;
+    mask[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+  const int matchword = (pattern.length() - 1) / 64;
+  const uint64_t matchmask = uint64_t(1) << ((pattern.length() - 1) % 64);
+
+  double score_threshold = dmp.Match_Threshold;
+  int best_loc = text.find(pattern, loc);
+  if (best_loc != -1) {
+    score_threshold = std::min(dmp.match_bitapScore(0, best_loc, loc, pattern), score_threshold);
+    best_loc = text.rfind(pattern, loc + pattern.length());
+    if (best_loc != -1) {
+      score_threshold = std::min(dmp.match_bitapScore(0, best_loc, loc, pattern), score_threshold);
+    }
+  }
+
+  best_loc = -1;
+  int bin_max = pattern.length() + text.length();
+  std::vector<std::vector<uint64_t>> last_rd;
+  for (int d = 0; d < static_cast<int>(pattern.length()); d++) {
+    int bin_min = 0;
+    int bin_mid = bin_max;
+    while (bin_min < bin_mid) {
+      if (dmp.match_bitapScore(d, loc + bin_mid, loc, pattern) <= score_threshold) {
+        bin_min = bin_mid;
+      } else {
+        bin_max = bin_mid;
+      }
+      bin_mid = (bin_max - bin_min) / 2 + bin_min;
+    }
+    bin_max = bin_mid;
+    int start = std::max(1, loc - bin_mid + 1);
+    const int finish = std::min(loc + bin_mid, static_cast<int>(text.length())) + pattern.length();
+
+    std::vector<std::vector<uint64_t>> rd(finish + 2, std::vector<uint64_t>(words));
+    for (int w = 0; w < words; w++) {
+      const int bits = std::min(std::max(d - 64 * w, 0), 64);
+      rd[finish + 1][w] = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+    }
+    for (int j = finish; j >= start; j--) {
+      std::vector<uint64_t> charMatch(words);
+      if (static_cast<int>(text.length()) > j - 1 && s.count(text[j - 1]) != 0) {
+        charMatch = s[text[j - 1]];
+      }
+      uint64_t carry = 1;
+      uint64_t last_carry = 1;
+      for (int w = 0; w < words; w++) {
+        const uint64_t shifted = (rd[j + 1][w] << 1) | carry;
+        carry = rd[j + 1][w] >> 63;
+        rd[j][w] = shifted & charMatch[w];
+        if (d > 0) {
+          const uint64_t either = last_rd[j + 1][w] | last_rd[j][w];
+          rd[j][w] |= ((either << 1) | last_carry) | last_rd[j + 1][w];
+          last_carry = either >> 63;
+        }
+      }
+      if ((rd[j][matchword] & matchmask) != 0) {
+        const double score = dmp.match_bitapScore(d, j - 1, loc, pattern);
+        if (score <= score_threshold) {
+          score_threshold = score;
+          best_loc = j - 1;
+          if (best_loc > loc) {
+            start = std::max(1, 2 * loc - best_loc);
+          } else {
+            break;
+          }
+        }
+      }
+    }
+    if (dmp.match_bitapScore(d + 1, loc, loc, pattern) > score_threshold) {
+      break;
+    }
+    last_rd.swap(rd);
+  }
+  return best_loc;
+}
+
 // Construct the two texts which made up the diff originally.
 std::deque<std::wstring> diff_match_patch_test::diff_rebuildtexts(std::deque<Diff> diffs) {
   std::deque<std::wstring> text;
@@ -44,10 +44,31 @@ class diff_match_patch_test {
   void testDiffLevenshtein();
   void testDiffBisect();
   void testDiffMain();
+  void testDiffStream();
+  void testDiffHunks();
+  void testDiffWindow();
+  void testDiffIncremental();
+  void testDiffCache();
+  void testDiffBatch();
+  void testOptions();
+  void testDiffHistogram();
+  void testDiffAnchored();
+  void testDiffBitParallel();
+  void testDiffOnp();
+  void testDiffPlan();
+  void testDiffRace();
+  void testDiffBounded();
+  void testDiffSimilarWithin();
+  void testDiffStats();
 
   //  MATCH TEST FUNCTIONS
   void testMatchAlphabet();
   void testMatchBitap();
+  void testMatchMyers();
+  void testMatchIndex();
+  void testMatchMany();
+  void testMatchCandidates();
+  void testMatchPattern();
   void testMatchMain();
 
   //  PATCH TEST FUNCTIONS
@@ -88,6 +109,8 @@ class diff_match_patch_test {
     assertEquals<I + 1, Args...>(strCase, tuple1, tuple2);
   }
 
+  // Bitap as originally written, one error level at a time.
+  int match_bitapReference(const std::wstring &text, const std::wstring &pattern, int loc);
   // Construct the two texts which made up the diff originally.
   std::deque<std::wstring> diff_rebuildtexts(std::deque<Diff> diffs);
   // Private function for quickly building lists of diffs.